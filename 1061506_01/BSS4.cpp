@@ -1,6 +1,9 @@
 /*
    compile: g++ -o BSS BSS4.cpp -lrt
-   exec: ./BSS
+   exec: ./BSS #num [--pin rr|compact] [--numa]
+      --pin rr       one player per core, spread over the NUMA nodes and physical cores first
+      --pin compact  players packed onto neighbouring cpus, SMT siblings and one node first
+      --numa         the shared region is placed on the NUMA node of the first attacker
 */
 
 #include <stdio.h>
@@ -9,12 +12,15 @@
 #include <unistd.h>
 #include <time.h>
 #include <utility>
+#include <tuple>
 #include <string>
 #include <vector>
 #include <algorithm>
 #include <functional>
+#include <sched.h>
 #include <sys/file.h>
 #include <sys/mman.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 
 void error_and_die(const char *msg) {
@@ -74,6 +80,39 @@ struct battleship {
    ~battleship() = default;
 };
 
+// turn handoff latency: from the attacker giving the turn away to the next one taking it,
+// log2 buckets of nanoseconds. only the player taking the turn writes, so no lock is needed
+const int HIST_N = 40;
+
+struct handoff_hist {
+   long long start_ns = 0;
+   size_t count = 0;
+   size_t buckets[HIST_N]{};
+
+   void add(long long ns) {
+      int b = 0;
+      while(b < HIST_N - 1 && (2ll << b) <= ns)
+         ++b;
+      ++buckets[b];
+      ++count;
+   }
+
+   // a power of 2 ns that at least a share q of the turns were handed over within
+   long long quantile(double q) const {
+      size_t seen = 0;
+      for(int b = 0; b < HIST_N; ++b)
+         if((seen += buckets[b]) >= q * count && buckets[b])
+            return 2ll << b;
+      return 0;
+   }
+};
+
+long long now_ns() {
+   timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return t.tv_sec * 1000000000ll + t.tv_nsec;
+}
+
 struct bs_region {
    size_t player_num = 0;
    int game_state = 0;
@@ -88,6 +127,8 @@ struct bs_region {
    
    pid_t pids[MAX_P];
    std::pair<int, int> score[MAX_P];
+
+   alignas(64) handoff_hist handoff; // on its own cache lines, away from turn and ask
 };
 
 const int COL = 4, ROW = 4;
@@ -95,6 +136,124 @@ const int COL = 4, ROW = 4;
 std::vector<std::pair<int, int> > my_pos, attack_stack, dir{{1, 0}, {0, 1}, {-1, 0}, {0, -1}};
 std::string name;
 
+/* cpu placement, read from /sys without libnuma
+   cpus are the ones this process may run on, in the order players are pinned to them */
+struct cpu_info {
+   int cpu, node, package, core;
+};
+std::vector<cpu_info> cpus;
+
+std::vector<int> read_cpulist(const char *path) {
+   std::vector<int> list;
+   FILE *f = fopen(path, "r");
+   if(!f)
+      return list;
+   int a, b;
+   while(fscanf(f, "%d", &a) == 1) {
+      b = a;
+      if(fscanf(f, "-%d", &b) < 0)
+         break;
+      for(int c = a; c <= b; ++c)
+         list.push_back(c);
+      if(fgetc(f) != ',')
+         break;
+   }
+   fclose(f);
+   return list;
+}
+
+int read_int(const char *path) {
+   int v = 0;
+   FILE *f = fopen(path, "r");
+   if(f) {
+      if(fscanf(f, "%d", &v) != 1)
+         v = 0;
+      fclose(f);
+   }
+   return v;
+}
+
+void plan_cpus(bool compact) {
+   cpu_set_t set;
+   if(sched_getaffinity(0, sizeof set, &set))
+      error_and_die("sched_getaffinity");
+   char path[100];
+   std::vector<int> node_of(CPU_SETSIZE);
+   for(int n : read_cpulist("/sys/devices/system/node/online")) {
+      sprintf(path, "/sys/devices/system/node/node%d/cpulist", n);
+      for(int c : read_cpulist(path))
+         if(c < CPU_SETSIZE)
+            node_of[c] = n;
+   }
+   for(int c = 0; c < CPU_SETSIZE; ++c)
+      if(CPU_ISSET(c, &set)) {
+         cpu_info ci{c, node_of[c], 0, 0};
+         sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/physical_package_id", c);
+         ci.package = read_int(path);
+         sprintf(path, "/sys/devices/system/cpu/cpu%d/topology/core_id", c);
+         ci.core = read_int(path);
+         cpus.push_back(ci);
+      }
+   auto key = [](cpu_info const& c) { return std::make_tuple(c.node, c.package, c.core, c.cpu); };
+   std::sort(cpus.begin(), cpus.end(), [&](auto const& a, auto const& b) { return key(a) < key(b); });
+   if(compact)
+      return;
+   // round-robin: the k-th cpu of every node before the (k+1)-th of any, siblings of a core last
+   std::vector<std::tuple<int, int, int> > rank; // (smt rank, position in its node, node)
+   for(size_t i = 0; i < cpus.size(); ++i) {
+      int smt = 0, pos = 0;
+      for(size_t j = 0; j < i; ++j)
+         if(cpus[j].node == cpus[i].node) {
+            if(cpus[j].package == cpus[i].package && cpus[j].core == cpus[i].core)
+               ++smt;
+            else
+               ++pos;
+         }
+      rank.emplace_back(smt, pos, cpus[i].node);
+   }
+   std::vector<size_t> idx(cpus.size());
+   for(size_t i = 0; i < idx.size(); ++i)
+      idx[i] = i;
+   std::sort(idx.begin(), idx.end(), [&](size_t a, size_t b) { return rank[a] < rank[b]; });
+   std::vector<cpu_info> ordered;
+   for(size_t i : idx)
+      ordered.push_back(cpus[i]);
+   cpus = ordered;
+}
+
+cpu_info const& cpu_of(int id) {
+   return cpus[id % cpus.size()];
+}
+
+void pin_self(int id) {
+   cpu_set_t set;
+   CPU_ZERO(&set);
+   CPU_SET(cpu_of(id).cpu, &set);
+   if(sched_setaffinity(0, sizeof set, &set))
+      error_and_die("sched_setaffinity");
+}
+
+// MPOL_PREFERRED for the pages of [ptr, ptr + len), the ones already there are moved.
+// only a hint: without NUMA support (ENOSYS) or when it is not allowed (EPERM) the pages stay where they are
+const int MPOL_PREFERRED_ = 1, MPOL_MF_MOVE_ = 1 << 1, MPOL_F_NODE_ = 1 << 0, MPOL_F_ADDR_ = 1 << 1;
+
+bool place_on_node(void *ptr, size_t len, int node) {
+   unsigned long mask[4]{};
+   mask[node / 64] = 1ul << node % 64;
+   if(syscall(SYS_mbind, ptr, len, MPOL_PREFERRED_, mask, 256ul, MPOL_MF_MOVE_)) {
+      perror("mbind, shared region not placed");
+      return false;
+   }
+   return true;
+}
+
+int node_of_page(void *ptr) {
+   int node = -1;
+   if(syscall(SYS_get_mempolicy, &node, NULL, 0ul, ptr, MPOL_F_NODE_ | MPOL_F_ADDR_))
+      return -1;
+   return node;
+}
+
 template<typename T>
 void creat_n_battleship(T& bs_ptr, pid_t& id) {
    int n = bs_ptr->player_num;
@@ -142,9 +301,18 @@ void init_self(pid_t id) {
 }
 
 int main(int argc, char *argv[]) {
-   if(argc != 2) {
-      char msg[100]{};
-      sprintf(msg, "run this program with \"./BSS #num\", and #num should be less than %d", MAX_P - 2);
+   const char *pin = nullptr;
+   bool numa = false;
+   for(int k = 2; k < argc; ++k)
+      if(!strcmp(argv[k], "--pin") && k + 1 < argc && (!strcmp(argv[k + 1], "rr") || !strcmp(argv[k + 1], "compact")))
+         pin = argv[++k];
+      else if(!strcmp(argv[k], "--numa"))
+         numa = true;
+      else
+         argc = 0;
+   if(argc < 2) {
+      char msg[150]{};
+      sprintf(msg, "run this program with \"./BSS #num [--pin rr|compact] [--numa]\", and #num should be less than %d", MAX_P - 2);
       error_and_die(msg);
    }
 
@@ -158,8 +326,24 @@ int main(int argc, char *argv[]) {
    int id = -1;
    SHM_<bs_region> bs_ptr("BSS");
    bs_ptr->player_num = player_num;
+   if(pin || numa)
+      plan_cpus(pin && !strcmp(pin, "compact"));
+   if(numa) {
+      // player 0 attacks first, without pinning it stays where the parent runs now
+      int node = cpu_of(0).node;
+      if(!pin) {
+         unsigned cpu, n;
+         node = syscall(SYS_getcpu, &cpu, &n, NULL) ? 0 : n;
+      }
+      if(place_on_node(bs_ptr.ptr, bs_ptr.region_size, node)) {
+         printf("[%d Parent]: shared region on node %d\n", getpid(), node_of_page(bs_ptr.ptr));
+         fflush(stdout); // not again in every child
+      }
+   }
    
    init_game(bs_ptr, id);
+   if(pin)
+      pin_self(id);
    init_self(id);
    bs_ptr->score[id].second = id;
    
@@ -167,6 +351,8 @@ int main(int argc, char *argv[]) {
    for(auto& p : my_pos)
       sprintf(poses + strlen(poses), "(%d,%d)", p.first, p.second);
    printf("%s: The gunboat: %s\n", name.c_str(), poses);
+   if(pin)
+      printf("%s: pinned to cpu %d (node %d)\n", name.c_str(), cpu_of(id).cpu, cpu_of(id).node);
    
    auto& ships = bs_ptr->ships;
    auto& self = ships[id];
@@ -175,6 +361,7 @@ int main(int argc, char *argv[]) {
    while(bs_ptr->game_state == 0)
       if(!id && std::all_of(ships, ships + player_num, [](auto const& s) -> bool { return s.ready; })) {
          std::for_each(ships, ships + player_num, [](auto& s) -> void { s.ready = false; });
+         bs_ptr->handoff.start_ns = now_ns();
          bs_ptr->turn = 0;
          bs_ptr->game_state = 1;
       }
@@ -184,6 +371,7 @@ int main(int argc, char *argv[]) {
    
    while(!my_pos.empty()) {
       if(bs_ptr->turn == id && !self.ready) {
+         bs_ptr->handoff.add(now_ns() - bs_ptr->handoff.start_ns);
          bs_ptr->hit_pos = attack_stack.back();
          attack_stack.pop_back();
          ++self.bombs_num;
@@ -212,6 +400,7 @@ int main(int argc, char *argv[]) {
             bs_ptr->ask = false;
             break;
          }
+         bs_ptr->handoff.start_ns = now_ns();
          do
             bs_ptr->turn = (bs_ptr->turn + 1) % player_num;
          while(ships[bs_ptr->turn].lose);
@@ -253,5 +442,15 @@ int main(int argc, char *argv[]) {
    puts("");
    printf("%s: %d wins with %lu bomb%s\n", name.c_str(), bs_ptr->pids[bs_ptr->winner_id], ships[bs_ptr->winner_id].bombs_num, ships[bs_ptr->winner_id].bombs_num > 1 ? "s" : "");
 
+   auto const& h = bs_ptr->handoff;
+   printf("\n%s: turn handoff latency, %lu turns, p50 < %lldns, p99 < %lldns\n", name.c_str(), h.count, h.quantile(0.5), h.quantile(0.99));
+   size_t most = *std::max_element(h.buckets, h.buckets + HIST_N);
+   for(int b = 0; b < HIST_N; ++b)
+      if(h.buckets[b]) {
+         char bar[41]{};
+         memset(bar, '#', std::max<size_t>(1, h.buckets[b] * 40 / most));
+         printf("%s: < %12lldns %6lu %s\n", name.c_str(), 2ll << b, h.buckets[b], bar);
+      }
+
    return 0;
 }
@@ -1,10 +1,17 @@
 /* 
     This cpp file is used to illustrate the invocation of pthread_create() in c++ and the compilation with g++.
     compile: g++ -o prog2_1506 1061506_02.cpp -std=c++17 -lpthread
-    exec: ./prog2_1506 filename 
+    exec: ./prog2_1506 filename [--tfidf f32|i8 [#sample_docs] | --ooc #budget_MB [spill_file]]
+      --tfidf  cosine of TF-IDF weights kept in one compact arena, float32 or int8 quantized,
+               instead of the raw counts. the main thread reports memory, and with #sample_docs
+               speed and error against the exact path over every pair of that many documents
+      --ooc    out of core: the sparse vectors are spilled to spill_file (default filename.spill) and
+               the pairs are computed in blocks within the budget, only each Avg_cosine is printed
 */
 /* Includes */
 #include <algorithm>    // all_of, replace_if, max_element
+#include <chrono>
+#include <cstdint>
 #include <errno.h>      /* Errors */
 #include <fstream>
 #include <functional>
@@ -15,7 +22,9 @@
 #include <sstream>
 #include <stdio.h>      /* Input/Output */
 #include <stdlib.h>     /* General Utilities */
+#include <string.h>
 #include <string>
+#include <sys/resource.h>
 #include <sys/types.h>  /* Primitive System Data Types */ 
 #include <unistd.h>     /* Symbolic Constants */
 #include <vector>
@@ -39,13 +48,104 @@ typedef struct str_thdata
 } thdata;
 
 int Num, Update_Num;
-map<string, int> Basis;             // 用來紀錄所有有出現的字
+map<string, int> Basis;             // 用來紀錄所有有出現的字 以及出現在幾份文件中
 vector<map<string, int> > Doc_Vecs; // 所有文件各自的詞頻向量
 vector<double> Vec_Lens;            // 紀錄每份文件各自的向量長度 方便計算cosine值
 vector<thdata> Datas;         /* structs to be passed to threads */
 vector<pthread_t> Threads;  /* thread variables */
 pthread_mutex_t all_fin_mutex, all_updated_mutex, update_vec_mutex, output_mutex; // 保持同步的mutex
 
+enum weight_t { raw_count, tfidf_f32, tfidf_i8 };
+weight_t Weight = raw_count;
+
+/* TF-IDF weights of every document in one CSR arena
+   row d holds only the words document d has, by their index in Basis, weighted by
+   tf * idf and normalized to length 1, so a cosine is a sparse dot product.
+   int8 rows are quantized to [-127, 127] with one scale per row. */
+struct csr_arena {
+    vector<size_t> ofs;     // row d is [ofs[d], ofs[d + 1])
+    vector<uint32_t> term;  // index in Basis, ascending in a row
+    vector<float> f32;
+    vector<int8_t> i8;
+    vector<float> scale;    // int8 value * scale = weight
+
+    void alloc(vector<int> const& nnz) {
+        ofs.assign(nnz.size() + 1, 0);
+        for(size_t d = 0; d < nnz.size(); ++d)
+            ofs[d + 1] = ofs[d] + nnz[d];
+        term.resize(ofs.back());
+        if(Weight == tfidf_f32)
+            f32.resize(ofs.back());
+        else
+            i8.resize(ofs.back());
+        scale.resize(nnz.size());
+    }
+
+    // w holds the normalized weights of row d
+    void fill(int d, vector<float> const& w) {
+        if(Weight == tfidf_f32) {
+            copy(w.begin(), w.end(), f32.begin() + ofs[d]);
+            return;
+        }
+        float m = 0;
+        for(float x : w)
+            m = max(m, fabsf(x));
+        scale[d] = m / 127;
+        for(size_t k = 0; k < w.size(); ++k)
+            i8[ofs[d] + k] = m ? (int8_t)lrintf(w[k] / scale[d]) : 0;
+    }
+
+    double dot(int a, int b) const {
+        size_t p = ofs[a], pe = ofs[a + 1], q = ofs[b], qe = ofs[b + 1];
+        if(Weight == tfidf_f32) {
+            float sum = 0;
+            while(p < pe && q < qe)
+                if(term[p] == term[q])
+                    sum += f32[p++] * f32[q++];
+                else if(term[p] < term[q])
+                    ++p;
+                else
+                    ++q;
+            return sum;
+        }
+        int32_t sum = 0;
+        while(p < pe && q < qe)
+            if(term[p] == term[q])
+                sum += i8[p++] * i8[q++];
+            else if(term[p] < term[q])
+                ++p;
+            else
+                ++q;
+        return (double)sum * scale[a] * scale[b];
+    }
+
+    size_t bytes(int d) const {
+        return (ofs[d + 1] - ofs[d]) * (sizeof(uint32_t) + (Weight == tfidf_f32 ? sizeof(float) : sizeof(int8_t)))
+            + sizeof(size_t) + sizeof(float);
+    }
+} Arena;
+vector<int> Nnz; // 每份文件有幾種字
+int Sample_Docs;  // --tfidf 拿來和exact path比較的文件數 0則不比較
+vector<bool> Sampled; // 被抽到的文件留著詞頻向量 其他的寫進arena後就釋放
+
+// smoothed idf, never 0 so no row is all zeros
+double idf(int df) {
+    return log((1.0 + Num) / (1.0 + df)) + 1;
+}
+
+// VmHWM of this process, ru_maxrss keeps the peak of the one that exec'd it
+double peak_rss_mb() {
+    ifstream fin("/proc/self/status");
+    string key;
+    double kb;
+    while(fin >> key)
+        if(key == "VmHWM:" && fin >> kb)
+            return kb / 1024;
+    rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_maxrss / 1024.0;
+}
+
 void init(string file_name) {
     all_fin_mutex = PTHREAD_MUTEX_INITIALIZER;
     all_updated_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -64,6 +164,20 @@ void init(string file_name) {
     }
     Doc_Vecs.resize(Num);
     Vec_Lens.resize(Num);
+    Nnz.resize(Num);
+    Sampled.resize(Num);
+    for(int k = 0, S = min(Sample_Docs, Num); S > 1 && k < S; ++k)
+        Sampled[(size_t)k * Num / S] = true;
+}
+
+// 文件內容只要是符號就替換成空白 只計算全部都是字母的字
+void count_words(string& article, map<string, int>& vec) {
+    replace_if(article.begin(), article.end(), [](char c)->bool { return ispunct(c); }, ' ');
+    stringstream ss(article);
+    string tmp;
+    while(ss >> tmp)
+        if(all_of(tmp.begin(), tmp.end(), [](char c)->bool { return isalpha(c); }))
+            ++vec[tmp];
 }
 
 void create_threads() {
@@ -76,9 +190,362 @@ void create_threads() {
     }
 }
 
+/* memory of the arena, then the exact path with TF-IDF weights: padded maps of doubles
+   like the raw counts, rebuilt from the kept counts of the Sampled documents, timed over every pair among them and compared with the arena */
+void report_tfidf() {
+    size_t arena_bytes = 0;
+    for(int d = 0; d < Num; ++d)
+        arena_bytes += Arena.bytes(d);
+    // a map node: 4 pointer sized links and color, then the pair
+    size_t map_bytes = Basis.size() * (4 * sizeof(void*) + sizeof(pair<const string, double>)) + sizeof(double);
+    printf("[Main thread] TF-IDF %s: %zu words, memory per document %.1lf bytes (exact %zu bytes, %.1lfx less), peak RSS %.1lf MB\n",
+        Weight == tfidf_f32 ? "float32" : "int8", Basis.size(), (double)arena_bytes / Num, map_bytes,
+        map_bytes * Num / (double)arena_bytes, peak_rss_mb());
+    if(Sample_Docs < 2 || Num < 2)
+        return;
+
+    size_t S = min(Sample_Docs, Num);
+    vector<int> docs(S);
+    for(size_t k = 0; k < S; ++k)
+        docs[k] = k * Num / S;    // the ones init() marked in Sampled
+    vector<map<string, double> > exact(S);
+    vector<double> lens(S);
+    for(size_t k = 0; k < S; ++k) {
+        auto& vec = Doc_Vecs[docs[k]];
+        auto it = vec.begin();
+        for(auto& [word, df] : Basis) {
+            double w = it != vec.end() && it->first == word ? (it++)->second * idf(df) : 0.0;
+            exact[k][word] = w;
+            lens[k] += w * w;
+        }
+        lens[k] = sqrt(lens[k]);
+    }
+
+    long long pairs = (long long)S * (S - 1);
+    vector<double> cos(S * S);
+    auto t0 = chrono::steady_clock::now();
+    for(size_t a = 0; a < S; ++a)
+        for(size_t b = 0; b < S; ++b)
+            if(a != b) {
+                double dot = 0.0;
+                for(auto it1 = exact[a].begin(), it2 = exact[b].begin(); it1 != exact[a].end(); ++it1, ++it2)
+                    dot += it1->second * it2->second;
+                cos[a * S + b] = dot / (lens[a] * lens[b]);
+            }
+    auto t1 = chrono::steady_clock::now();
+    volatile double sum = 0.0; // keeps the timed loop
+    for(size_t a = 0; a < S; ++a)
+        for(size_t b = 0; b < S; ++b)
+            if(a != b)
+                sum += Arena.dot(docs[a], docs[b]);
+    auto t2 = chrono::steady_clock::now();
+
+    // |cos' - cos| <= ea + eb + ea * eb, where e is the length of a row's rounding error:
+    // int8: at most scale / 2 per word, float32: 2^-24 relative per word plus 2^-24 per addition
+    auto row_err = [](int d) {
+        size_t n = Arena.ofs[d + 1] - Arena.ofs[d];
+        return Weight == tfidf_f32 ? ldexp(1.0, -24) * (1 + n) : Arena.scale[d] / 2 * sqrt((double)n);
+    };
+    double max_err = 0.0, bound = 0.0;
+    for(size_t a = 0; a < S; ++a)
+        for(size_t b = 0; b < S; ++b)
+            if(a != b) {
+                max_err = max(max_err, fabs(Arena.dot(docs[a], docs[b]) - cos[a * S + b]));
+                bound = max(bound, row_err(docs[a]) + row_err(docs[b]) + row_err(docs[a]) * row_err(docs[b]));
+            }
+
+    double exact_s = chrono::duration<double>(t1 - t0).count(), arena_s = chrono::duration<double>(t2 - t1).count();
+    printf("[Main thread] TF-IDF similarity over %zu documents: %.0lf pairs/s (exact %.0lf pairs/s, %.1lfx faster), max error %.2e (bound %.2e)\n",
+        S, pairs / arena_s, pairs / exact_s, exact_s / arena_s, max_err, bound);
+}
+
+/* out of core (--ooc)
+   pass 1 streams the input one document at a time and appends its sparse count vector
+   to the spill file: a row_head, the word ids ascending, their counts, then the
+   document id. a word id is a 64-bit hash of the word, so no vocabulary is kept, and the
+   rows are cut into blocks as they are written, so only the offset of each block stays
+   in memory.
+   pass 2 keeps each block A loaded while every block B is read in turn, and the rows of A
+   are split among the worker threads. the words of A are numbered in a word_table and
+   the entries of A and B are translated to those numbers once per pair of blocks, so each
+   worker scatters a row of A into a dense array of the words of A only, and each row of B
+   is a gather of its own words. a block is cut so that it, its translation, the table and
+   the dense arrays of all workers take at most half the budget, A and B together the budget.
+   outside of it stay the document pass 1 is counting, the file buffers and the worker stacks.
+   the counts are integers, so every cosine and every Avg_cosine sum, added in the same
+   order, is the same as the in-memory path unless two words hash to the same id. */
+struct row_head {
+    uint32_t nnz;
+    uint32_t id_len;    // bytes of the document id after the counts
+    double len;
+};
+
+const uint64_t* ids_of(const row_head* r) {
+    return (const uint64_t*)(r + 1);
+}
+
+const int32_t* counts_of(const row_head* r) {
+    return (const int32_t*)(ids_of(r) + r->nnz);
+}
+
+const char* doc_id_of(const row_head* r) {
+    return (const char*)(counts_of(r) + r->nnz);
+}
+
+// the document id is padded so the next row_head stays aligned
+size_t row_bytes(size_t nnz, size_t id_len) {
+    return (sizeof(row_head) + nnz * (sizeof(uint64_t) + sizeof(int32_t)) + id_len + 7) / 8 * 8;
+}
+
+// FNV-1a
+uint64_t word_id(string const& word) {
+    uint64_t h = 14695981039346656037ull;
+    for(unsigned char c : word)
+        h = (h ^ c) * 1099511628211ull;
+    return h;
+}
+
+struct ooc_block {
+    vector<char> buf;
+    vector<const row_head*> rows;
+    vector<uint32_t> local;     // the entries by their number in the words of A
+    vector<size_t> local_ofs;   // row d starts at local[local_ofs[d]]
+    int first = 0;
+
+    // the rows in [begin, end) of the spill file, the first one is row first_
+    void load(FILE* f, uint64_t begin, uint64_t end, int first_) {
+        first = first_;
+        buf.resize(end - begin);
+        if(fseeko(f, begin, SEEK_SET) || fread(buf.data(), 1, buf.size(), f) != buf.size()) {
+            fprintf(stderr, "fatal error: cannot read the spill file\n");
+            exit(EXIT_FAILURE);
+        }
+        rows.clear();
+        local_ofs.clear();
+        size_t nnz = 0;
+        for(size_t p = 0; p < buf.size(); ) {
+            auto r = (const row_head*)(buf.data() + p);
+            rows.push_back(r);
+            local_ofs.push_back(nnz);
+            nnz += r->nnz;
+            p += row_bytes(r->nnz, r->id_len);
+        }
+        local.resize(nnz);
+    }
+};
+
+/* the words of block A, sorted. the hashes are uniform, so the top bits of an id
+   point to a bucket of about one word, bucket[h] is the first word with those bits h */
+struct word_table {
+    vector<uint64_t> ids;
+    vector<uint32_t> bucket;
+    int shift = 63;
+
+    void build(ooc_block const& A) {
+        ids.clear();
+        for(auto r : A.rows)
+            ids.insert(ids.end(), ids_of(r), ids_of(r) + r->nnz);
+        sort(ids.begin(), ids.end());
+        ids.erase(unique(ids.begin(), ids.end()), ids.end());
+        int bits = 1;
+        while(bits < 32 && (1ull << bits) < ids.size())
+            ++bits;
+        shift = 64 - bits;
+        bucket.assign((1ull << bits) + 1, 0);
+        for(size_t h = 0, k = 0; h < bucket.size(); ++h) {
+            while(k < ids.size() && ids[k] >> shift < h)
+                ++k;
+            bucket[h] = k;
+        }
+    }
+
+    // the number of a word, ids.size() for the slot that stays 0 if it is not in A
+    uint32_t find(uint64_t id) const {
+        uint32_t k = bucket[id >> shift], e = bucket[(id >> shift) + 1];
+        while(k < e && ids[k] < id)
+            ++k;
+        return k < e && ids[k] == id ? k : ids.size();
+    }
+
+    void translate(ooc_block& B) const {
+        auto l = B.local.begin();
+        for(auto r : B.rows)
+            for(auto id = ids_of(r); id < ids_of(r) + r->nnz; ++id)
+                *l++ = find(*id);
+    }
+};
+
+struct ooc_work {
+    const ooc_block *A, *B;
+    vector<double>* sums; // running Avg_cosine of the rows of A
+    int begin, end;       // rows of A for this worker
+    vector<int32_t>* dense; // counts of one row by its number in the words of A, all 0 between rows
+};
+
+// row a is scattered into dense once, then each row of B is a gather of its own words
+void* ooc_worker(void* ptr) {
+    auto& w = *(ooc_work*)ptr;
+    auto& dense = *w.dense;
+    for(int a = w.begin; a < w.end; ++a) {
+        auto ra = w.A->rows[a];
+        auto la = &w.A->local[w.A->local_ofs[a]];
+        for(uint32_t k = 0; k < ra->nnz; ++k)
+            dense[la[k]] = counts_of(ra)[k];
+        for(int b = 0; b < (int)w.B->rows.size(); ++b)
+            if(w.A->first + a != w.B->first + b) {
+                auto rb = w.B->rows[b];
+                auto lb = &w.B->local[w.B->local_ofs[b]];
+                long long dot = 0;
+                for(uint32_t k = 0; k < rb->nnz; ++k)
+                    dot += (long long)dense[lb[k]] * counts_of(rb)[k];
+                (*w.sums)[a] += dot / (ra->len * rb->len) / (Num - 1);
+            }
+        for(uint32_t k = 0; k < ra->nnz; ++k)
+            dense[la[k]] = 0;
+    }
+    return NULL;
+}
+
+void out_of_core(string file_name, size_t budget, string spill_name) {
+    double start_rss = peak_rss_mb();
+    FILE* spill = fopen(spill_name.c_str(), "w+b");
+    if(!spill) {
+        fprintf(stderr, "fatal error: cannot create %s\n", spill_name.c_str());
+        exit(EXIT_FAILURE);
+    }
+    unlink(spill_name.c_str()); // 結束時自動刪除
+    auto t0 = chrono::steady_clock::now();
+
+    // pass 1: a block takes rows while it stays within half the budget, at least one row each.
+    // besides the rows themselves, an entry costs its number in the words of A, a word and
+    // at most 2 buckets in the word_table and a slot in the dense array of every worker,
+    // a row its pointer, offset and sum
+    int thread_num = max(1L, sysconf(_SC_NPROCESSORS_ONLN));
+    const size_t entry_cost = sizeof(uint32_t) + sizeof(uint64_t) + 2 * sizeof(uint32_t) + thread_num * sizeof(int32_t),
+        row_cost = sizeof(const row_head*) + sizeof(size_t) + sizeof(double);
+    vector<uint64_t> cut_ofs{ 0 };
+    vector<int> cuts{ 0 };
+    uint64_t spill_bytes = 0, nnz = 0, block_cost = 0, block_nnz = 0, max_block_nnz = 0;
+    ifstream fin(file_name);
+    string doc_id, article;
+    while(getline(fin, doc_id)) {
+        getline(fin, article);
+        map<string, int> vec;
+        count_words(article, vec);
+        vector<pair<uint64_t, int32_t> > row;
+        row_head head{ (uint32_t)vec.size(), (uint32_t)doc_id.size(), 0.0 };
+        for(auto& [word, count] : vec) {
+            row.push_back({ word_id(word), count });
+            head.len += count * count;
+        }
+        head.len = sqrt(head.len);
+        sort(row.begin(), row.end());
+        vector<uint64_t> ids(row.size());
+        vector<int32_t> counts(row.size());
+        for(size_t k = 0; k < row.size(); ++k)
+            tie(ids[k], counts[k]) = row[k];
+        size_t bytes = row_bytes(row.size(), doc_id.size()), cost = bytes + row.size() * entry_cost + row_cost;
+        if(Num > cuts.back() && block_cost + cost > budget / 2) {
+            cut_ofs.push_back(spill_bytes);
+            cuts.push_back(Num);
+            block_cost = block_nnz = 0;
+        }
+        doc_id.resize(bytes - sizeof head - row.size() * (sizeof(uint64_t) + sizeof(int32_t)));
+        fwrite(&head, sizeof head, 1, spill);
+        fwrite(ids.data(), sizeof(uint64_t), ids.size(), spill);
+        fwrite(counts.data(), sizeof(int32_t), counts.size(), spill);
+        fwrite(doc_id.data(), 1, doc_id.size(), spill);
+        spill_bytes += bytes;
+        block_cost += cost;
+        max_block_nnz = max(max_block_nnz, block_nnz += row.size());
+        nnz += row.size();
+        ++Num;
+    }
+    if(fflush(spill)) {
+        fprintf(stderr, "fatal error: cannot write the spill file\n");
+        exit(EXIT_FAILURE);
+    }
+    cut_ofs.push_back(spill_bytes);
+    cuts.push_back(Num);
+    int blocks = cuts.size() - 1;
+    auto t1 = chrono::steady_clock::now();
+    printf("[Main thread] out of core: %d documents, %llu nonzeros, spill %.1lf MB, budget %.1lf MB, %d blocks\n",
+        Num, (unsigned long long)nnz, spill_bytes / 1048576.0, budget / 1048576.0, blocks);
+
+    // pass 2: every buffer is reserved once for the largest block, so none is copied to grow
+    uint64_t max_block_bytes = 0;
+    for(int i = 0; i < blocks; ++i)
+        max_block_bytes = max(max_block_bytes, cut_ofs[i + 1] - cut_ofs[i]);
+    thdata key_doc;
+    key_doc.avg_cosine = -1;
+    ooc_block A, B;
+    word_table words;
+    vector<vector<int32_t> > dense(thread_num);
+    for(auto X : { &A, &B }) {
+        X->buf.reserve(max_block_bytes);
+        X->local.reserve(max_block_nnz);
+    }
+    words.ids.reserve(max_block_nnz);
+    for(auto& d : dense)
+        d.reserve(max_block_nnz + 1);
+    uint64_t bytes_read = 0;
+    for(int i = 0; i < blocks; ++i) {
+        A.load(spill, cut_ofs[i], cut_ofs[i + 1], cuts[i]);
+        bytes_read += A.buf.size();
+        words.build(A);
+        words.translate(A);
+        for(auto& d : dense)
+            d.assign(words.ids.size() + 1, 0);
+        vector<double> sums(A.rows.size());
+        for(int j = 0; j < blocks; ++j) {
+            const ooc_block* b = &A;
+            if(j != i) {
+                B.load(spill, cut_ofs[j], cut_ofs[j + 1], cuts[j]);
+                bytes_read += B.buf.size();
+                words.translate(B);
+                b = &B;
+            }
+            vector<ooc_work> works(thread_num);
+            vector<pthread_t> workers(thread_num);
+            int n = A.rows.size();
+            for(int k = 0; k < thread_num; ++k) {
+                works[k] = { &A, b, &sums, n * k / thread_num, n * (k + 1) / thread_num, &dense[k] };
+                pthread_create(&workers[k], NULL, ooc_worker, (void *) &works[k]);
+            }
+            for(auto& thr : workers)
+                pthread_join(thr, NULL);
+        }
+        for(int a = 0; a < (int)A.rows.size(); ++a) {
+            thdata td;
+            td.doc_id.assign(doc_id_of(A.rows[a]), A.rows[a]->id_len);
+            td.avg_cosine = sums[a];
+            printf("[Main thread] DocID:%s Avg_cosine: %.6lf\n", td.doc_id.c_str(), td.avg_cosine);
+            if(key_doc < td)
+                key_doc = td;
+        }
+    }
+    fclose(spill);
+    auto t2 = chrono::steady_clock::now();
+
+    printf("[Main thread] KeyDocID:%s Highest Average Cosine: %.6lf\n", key_doc.doc_id.c_str(), key_doc.avg_cosine);
+    double peak_rss = peak_rss_mb(), spill_s = chrono::duration<double>(t1 - t0).count(), pair_s = chrono::duration<double>(t2 - t1).count();
+    printf("[Main thread] spill %.3lfs, pairs %.3lfs: %.1lf MB read (%.1lf MB/s), %.0lf pairs/s\n",
+        spill_s, pair_s, bytes_read / 1048576.0, bytes_read / 1048576.0 / pair_s, (double)Num * (Num - 1) / pair_s);
+    printf("[Main thread] peak RSS %.1lf MB: %.1lf MB at start, %.1lf MB above it against the budget of %.1lf MB\n",
+        peak_rss, start_rss, peak_rss - start_rss, budget / 1048576.0);
+}
+
 int main(int argc, char* argv[]) {
-    if(argc != 2) {
-        fprintf(stderr, "fatal error: no input file or too many input files\n");
+    if((argc == 4 || argc == 5) && !strcmp(argv[2], "--tfidf") && (!strcmp(argv[3], "f32") || !strcmp(argv[3], "i8"))
+        && (argc == 4 || (!argv[4][strspn(argv[4], "0123456789")] && (Sample_Docs = atoi(argv[4])) > 1)))
+        Weight = !strcmp(argv[3], "f32") ? tfidf_f32 : tfidf_i8;
+    else if((argc == 4 || argc == 5) && !strcmp(argv[2], "--ooc") && atof(argv[3]) > 0) {
+        out_of_core(argv[1], atof(argv[3]) * 1048576, argc == 5 ? argv[4] : string(argv[1]) + ".spill");
+        exit(0);
+    }
+    else if(argc != 2) {
+        fprintf(stderr, "fatal error: no input file or too many input files\n"
+            "usage: %s filename [--tfidf f32|i8 [#sample_docs] | --ooc #budget_MB [spill_file]]\n", argv[0]);
         exit(EXIT_FAILURE);
     }
     
@@ -92,6 +559,8 @@ int main(int argc, char* argv[]) {
     // 尋找關鍵文件
     auto& key_doc = *max_element(Datas.begin(), Datas.end());
     printf("[Main thread] KeyDocID:%s Highest Average Cosine: %.6lf\n", key_doc.doc_id.c_str(), key_doc.avg_cosine);
+    if(Weight != raw_count)
+        report_tfidf();
     // 計算Main thread的CPU time
     timespec t;
     clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
@@ -106,34 +575,65 @@ void* article_analyzer ( void *ptr )
     pthread_t tid = pthread_self(); // 取得自己的tid
     map<string, int>& vec = Doc_Vecs[data.thread_no]; // 自己的詞頻向量表
 
-    replace_if(data.article.begin(), data.article.end(), [](char c)->bool { return ispunct(c); }, ' '); // 文件內容只要是符號就替換成空白
-    stringstream ss(data.article);
-    string tmp;
-    while(ss >> tmp)
-        if(all_of(tmp.begin(), tmp.end(), [](char c)->bool { return isalpha(c); }))
-            ++vec[tmp];
+    count_words(data.article, vec);
 
     // 現在要統一有出現過哪些字
     pthread_mutex_lock(&update_vec_mutex); // 等待上一個人更新完
     for(auto& [word, count] : vec)  // 將自己出現過的所有字
-        Basis[word];                // 都加到Basis裡面
-    if(++Update_Num == Num)
+        ++Basis[word];              // 都加到Basis裡面
+    Nnz[data.thread_no] = vec.size();
+    if(++Update_Num == Num) {
+        if(Weight != raw_count)     // 最後一個人知道所有文件的大小 配置arena
+            Arena.alloc(Nnz);
         pthread_mutex_unlock(&all_updated_mutex);
+    }
     pthread_mutex_unlock(&update_vec_mutex);
 
     pthread_mutex_lock(&all_updated_mutex); // 等待所有人都把資料更新上去
     pthread_mutex_unlock(&all_updated_mutex);
-    for(auto& [word, count] : Basis)    // 看看Basis裡面整理的所有字
-        vec[word];                      // 自己有出現過則出現次數不變 沒有則新增並歸零出現次數
+    if(Weight == raw_count)
+        for(auto& [word, count] : Basis)    // 看看Basis裡面整理的所有字
+            vec[word];                      // 自己有出現過則出現次數不變 沒有則新增並歸零出現次數
+    else {
+        // 不補0 依照Basis的順序把自己的字寫進arena
+        vector<float> w;
+        double len = 0.0;
+        uint32_t id = 0;
+        auto it = vec.begin();
+        for(auto& [word, df] : Basis) {
+            if(it != vec.end() && it->first == word) {
+                Arena.term[Arena.ofs[data.thread_no] + w.size()] = id;
+                w.push_back(it->second * idf(df));
+                len += (double)w.back() * w.back();
+                ++it;
+            }
+            ++id;
+        }
+        for(auto& x : w)
+            x /= sqrt(len);
+        Arena.fill(data.thread_no, w);
+    }
     pthread_mutex_lock(&output_mutex);
     printf("[TID=%lu] DocID:%s [", tid, data.doc_id.c_str());
     int not_first = 0;
     Vec_Lens[data.thread_no] = 0.0;
-    for(auto& [word, count] : vec) {
-        Vec_Lens[data.thread_no] += count * count;
-        if(not_first++)
-            printf(",");
-        printf("%d", count);
+    if(Weight == raw_count)
+        for(auto& [word, count] : vec) {
+            Vec_Lens[data.thread_no] += count * count;
+            if(not_first++)
+                printf(",");
+            printf("%d", count);
+        }
+    else {  // 沒有補0的向量 印出時再補
+        auto it = vec.begin();
+        for(auto& [word, df] : Basis) {
+            int count = it != vec.end() && it->first == word ? (it++)->second : 0;
+            if(not_first++)
+                printf(",");
+            printf("%d", count);
+        }
+        if(!Sampled[data.thread_no])
+            map<string, int>().swap(vec);   // 印完了 之後只用arena
     }
     Vec_Lens[data.thread_no] = sqrt(Vec_Lens[data.thread_no]);
     puts("]");
@@ -146,9 +646,13 @@ void* article_analyzer ( void *ptr )
     for(int i = 0; i < Num; ++i) {
         if(i != data.thread_no) {
             double cos = 0.0;
-            for(auto it1 = vec.begin(), it2 = Doc_Vecs[i].begin(); it1 != vec.end(); ++it1, ++it2)
-                cos += it1->second * it2->second;
-            cos /= Vec_Lens[data.thread_no] * Vec_Lens[i];
+            if(Weight != raw_count)
+                cos = Arena.dot(data.thread_no, i);
+            else {
+                for(auto it1 = vec.begin(), it2 = Doc_Vecs[i].begin(); it1 != vec.end(); ++it1, ++it2)
+                    cos += it1->second * it2->second;
+                cos /= Vec_Lens[data.thread_no] * Vec_Lens[i];
+            }
             data.avg_cosine += cos / (Num - 1);
             printf("[TID=%lu] cosine(%s,%s)=%.6lf\n", tid, data.doc_id.c_str(), Datas[i].doc_id.c_str(), cos);
         }
@@ -12,19 +12,77 @@
 #include <pthread.h>    /* POSIX Threads */
 #include <string.h>     /* String handling */
 #include <queue>
+#include <deque>
+#include <vector>
 #include <string>
 #include <list>
+#include <tuple>
+#include <memory>
+#include <functional>
+#include <algorithm>
+#include <atomic>
+#include <random>
 
 using std::string;
 using std::queue;
+using std::deque;
+using std::vector;
 
 /* prototype for thread routine */
 void *student_behavior (void *ptr);
 void *TA_behavior (void *ptr);
 void *Prof_behavior (void *ptr);
 
+inline long long mono_ns_() {
+   timespec t;
+   clock_gettime(CLOCK_MONOTONIC, &t);
+   return t.tv_sec * 1'000'000'000LL + t.tv_nsec;
+}
+
+/* handoff latency of my_sem_t in ns
+   a signal that releases a blocked waiter stamps the semaphore, the waiter measures from the
+   stamp to its wake up (signal-to-wake) and from its call to its return (time in wait).
+   every thread adds to its own slot, main reads them after the joins, so no lock is needed */
+const int SEM_BUCKETS = 40;   // log2 of ns
+struct sem_stats_t {
+   long long waits = 0, blocked = 0, wait_ns = 0, wake_ns = 0, wake_max = 0;
+   long long buckets[SEM_BUCKETS]{};
+   void add(long long in_wait, long long wake) {
+      ++waits;
+      wait_ns += in_wait;
+      if(wake < 0)
+         return;
+      ++blocked;
+      wake_ns += wake;
+      wake_max = std::max(wake_max, wake);
+      int b = 0;
+      while(b < SEM_BUCKETS - 1 && (2LL << b) <= wake)
+         ++b;
+      ++buckets[b];
+   }
+   void merge(sem_stats_t const& o) {
+      waits += o.waits;
+      blocked += o.blocked;
+      wait_ns += o.wait_ns;
+      wake_ns += o.wake_ns;
+      wake_max = std::max(wake_max, o.wake_max);
+      for(int b = 0; b < SEM_BUCKETS; ++b)
+         buckets[b] += o.buckets[b];
+   }
+   // signal-to-wake of the q-th blocked wait, rounded up to a power of 2 ns
+   long long quantile(double q) const {
+      long long seen = 0;
+      for(int b = 0; b < SEM_BUCKETS; ++b)
+         if(buckets[b] && (seen += buckets[b]) >= q * blocked)
+            return 2LL << b;
+      return 0;
+   }
+} sem_stats[53];   // Prof. TY, the TAs, then the students by sid + 2
+thread_local sem_stats_t* my_sem_stats = nullptr;
+
 struct my_sem_t {
    int n = 0;
+   long long signal_ns = 0;   // when a signal last released a blocked waiter
    pthread_mutex_t a, b, c;
    my_sem_t() {
       pthread_mutex_init(&a, NULL);
@@ -38,20 +96,26 @@ struct my_sem_t {
       pthread_mutex_destroy(&c);
    }
    void wait() {
+      long long t0 = mono_ns_(), wake = -1;
       pthread_mutex_lock(&a);
       pthread_mutex_lock(&c);
       if(--n < 0) {
          pthread_mutex_unlock(&c);
          pthread_mutex_lock(&b);
+         wake = mono_ns_() - signal_ns;   // signal_ns was written before b was unlocked
       }
       else
          pthread_mutex_unlock(&c);
+      if(my_sem_stats)
+         my_sem_stats->add(mono_ns_() - t0, wake);
       pthread_mutex_unlock(&a);
    }
    void signal() {
       pthread_mutex_lock(&c);
-      if(!++n)
+      if(!++n) {
+         signal_ns = mono_ns_();
          pthread_mutex_unlock(&b);
+      }
       pthread_mutex_unlock(&c);
    }
 };
@@ -60,10 +124,84 @@ struct my_sem_t {
    this shows how multiple data items can be passed to a thread */
 struct student_data_t {
     int sid, TA_id = -1, dis_time;
+    int TA_time, Prof_time, prio;   // drawn on enter, so every policy sees the same workload
+    long long arrive_ns;            // Poisson arrival offset from the start of the simulation
+    long long enter_ms, leave_ms;
+    long long talk_ns[2];           // how long the discussions with the TA and Prof. TY really took
     bool can_talk_with_TA = false, had_talked_with_TA = false;
     my_sem_t ack;
 } student_datas[50];
 
+/* scheduling policy: decides which waiting student a TA / the professor picks next */
+struct wait_queue_t {
+    virtual ~wait_queue_t() = default;
+    virtual void push(int sid) = 0;
+    virtual int pop(int who) = 0;   // who: 0 for Prof. TY, tid for the TAs
+    virtual size_t size() const = 0;
+    bool empty() const { return !size(); }
+};
+
+struct fifo_queue_t : wait_queue_t {
+    queue<int> q;
+    void push(int sid) override { q.push(sid); }
+    int pop(int) override {
+        int sid = q.front();
+        q.pop();
+        return sid;
+    }
+    size_t size() const override { return q.size(); }
+};
+
+/* smallest key first, FIFO among equal keys */
+struct keyed_queue_t : wait_queue_t {
+    using item_t = std::tuple<int, long long, int>; // key, arrival no., sid
+    std::function<int(student_data_t const&)> key;
+    std::priority_queue<item_t, vector<item_t>, std::greater<item_t> > q;
+    long long seq = 0;
+    keyed_queue_t(std::function<int(student_data_t const&)> k) : key(k) {}
+    void push(int sid) override { q.emplace(key(student_datas[sid - 1]), seq++, sid); }
+    int pop(int) override {
+        int sid = std::get<2>(q.top());
+        q.pop();
+        return sid;
+    }
+    size_t size() const override { return q.size(); }
+};
+
+/* one deque per TA, a TA with an empty deque steals from the back of the longest one */
+struct steal_queue_t : wait_queue_t {
+    vector<deque<int> > qs;
+    size_t n = 0;
+    steal_queue_t(int TA_n) : qs(TA_n) {}
+    void push(int sid) override {
+        std::min_element(qs.begin(), qs.end(),
+            [](auto const& a, auto const& b) -> bool { return a.size() < b.size(); })->push_back(sid);
+        ++n;
+    }
+    int pop(int who) override {
+        int sid;
+        auto& own = qs[who - 1];
+        if(own.size()) {
+            sid = own.front();
+            own.pop_front();
+        }
+        else {
+            auto& victim = *std::max_element(qs.begin(), qs.end(),
+                [](auto const& a, auto const& b) -> bool { return a.size() < b.size(); });
+            sid = victim.back();
+            victim.pop_back();
+        }
+        --n;
+        return sid;
+    }
+    size_t size() const override { return n; }
+};
+
+enum policy_t { FIFO_, SJF_, PRIO_, STEAL_, };
+const char* policy_names[] = { "fifo", "sjf", "prio", "steal", };
+enum backoff_t { RANDOM_, EXP_, BLOCK_, };
+const char* backoff_names[] = { "random", "exp", "block", };
+
 
 pthread_mutex_t TA_queue_mutex, Prof_queue_mutex;
 struct pt_data_t {
@@ -75,12 +213,18 @@ struct pt_data_t {
 int TA_num;
 int TY_core_num;
 int wait_TA_num;
-queue<int> wait_TA_queue, wait_Prof_queue;
+int seat_num = 5;
+policy_t policy = FIFO_;
+backoff_t backoff = RANDOM_;
+std::unique_ptr<wait_queue_t> wait_TA_queue, wait_Prof_queue;
 queue<int> idle_TA_queue, idle_Prof_queue;
+pthread_cond_t seat_cond;   // signaled whenever a TA frees a seat (backoff "block")
+double arrival_rate = 133.0;    // students per second
+unsigned seed = 0;
 
-bool end_ = false;
+std::atomic<bool> end_{false};
 
-pthread_mutex_t mutex_;
+static struct timespec start;
 
 struct timespec operator-(struct timespec end, struct timespec const& start) {
     end.tv_sec -= start.tv_sec;
@@ -92,22 +236,64 @@ struct timespec operator-(struct timespec end, struct timespec const& start) {
     return end;
 }
 
+/* every thread owns its generator, seeded by seed_rng_() with the thread's id,
+   which also picks the thread's slot of sem_stats */
+thread_local std::mt19937 rng_;
+
+inline void seed_rng_(int who) {
+    rng_.seed(seed * 1'000 + who);
+    my_sem_stats = &sem_stats[who < 3 ? who : who - 1];
+}
+
 inline int rnd(int begin, int end) {
-    return begin + rand() % (end - begin + 1);
+    return std::uniform_int_distribution<int>(begin, end)(rng_);
 }
 
 // pthread_mutex_trylock
 
+std::unique_ptr<wait_queue_t> make_queue_(bool for_Prof) {
+    switch(policy) {
+    case SJF_:
+        if(for_Prof)
+            return std::make_unique<keyed_queue_t>([](student_data_t const& s) { return s.Prof_time; });
+        // students coming back to wait for Prof. TY only need their seat
+        return std::make_unique<keyed_queue_t>([](student_data_t const& s) { return s.had_talked_with_TA ? 0 : s.TA_time; });
+    case PRIO_:
+        return std::make_unique<keyed_queue_t>([](student_data_t const& s) { return -s.prio; });
+    case STEAL_:
+        if(for_Prof)
+            return std::make_unique<fifo_queue_t>();
+        return std::make_unique<steal_queue_t>(TA_num);
+    default:
+        return std::make_unique<fifo_queue_t>();
+    }
+}
+
+template<typename E, size_t N>
+E parse_name_(const char* s, const char* (&names)[N], const char* what) {
+    for(size_t i = 0; i < N; ++i)
+        if(!strcmp(s, names[i]))
+            return E(i);
+    fprintf(stderr, "unknown %s \"%s\"\n", what, s);
+    exit(EXIT_FAILURE);
+}
+
 struct initializer {
     initializer() {
-        srand(0);
-        pthread_mutex_init(&mutex_, NULL);
         pthread_mutex_init(&TA_queue_mutex, NULL);
         pthread_mutex_init(&Prof_queue_mutex, NULL);
+        pthread_cond_init(&seat_cond, NULL);
+        wait_TA_queue = make_queue_(false);
+        wait_Prof_queue = make_queue_(true);
 
         /* initialize data to pass to student thread */
-        for(int i = 0; i < 50; ++i)
+        std::mt19937 arrival_rng(seed);
+        std::exponential_distribution<double> gap(arrival_rate);
+        double t = 0.0;
+        for(int i = 0; i < 50; ++i) {
             student_datas[i].sid = i + 1;
+            student_datas[i].arrive_ns = (t += gap(arrival_rng)) * 1e9;
+        }
 
         char names[][20] = {
             "Prof. TY",
@@ -118,15 +304,17 @@ struct initializer {
             pt_datas[i].name = names[i];
     }
     ~initializer() {
-        pthread_mutex_destroy(&mutex_);
         pthread_mutex_destroy(&TA_queue_mutex);
         pthread_mutex_destroy(&Prof_queue_mutex);
+        pthread_cond_destroy(&seat_cond);
     }
 };
 
 int main(int argc, char* argv[]) {
-    if(argc != 3) {
-        fprintf(stderr, "execute with: \"./TYSIM #TA_num(1~2) #enable_double_core(0 or 1)\"\n");
+    if(argc < 3 || argc % 2 == 0) {
+        fprintf(stderr, "execute with: \"./TYSIM #TA_num(1~2) #enable_double_core(0 or 1)"
+            " [--policy fifo|sjf|prio|steal] [--seats #n] [--backoff random|exp|block]"
+            " [--rate #students_per_sec] [--seed #n]\"\n");
         exit(EXIT_FAILURE);
     } else {
         TA_num = std::stoi(argv[1]);
@@ -140,9 +328,36 @@ int main(int argc, char* argv[]) {
             exit(EXIT_FAILURE);
         }
         ++TY_core_num;
+        for(int i = 3; i < argc; i += 2) {
+            if(!strcmp(argv[i], "--policy"))
+                policy = parse_name_<policy_t>(argv[i + 1], policy_names, "policy");
+            else if(!strcmp(argv[i], "--backoff"))
+                backoff = parse_name_<backoff_t>(argv[i + 1], backoff_names, "backoff");
+            else if(!strcmp(argv[i], "--seats")) {
+                seat_num = std::stoi(argv[i + 1]);
+                if(seat_num < 1) {
+                    fprintf(stderr, "The value of #seats should be at least 1\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            else if(!strcmp(argv[i], "--rate")) {
+                arrival_rate = std::stod(argv[i + 1]);
+                if(arrival_rate <= 0) {
+                    fprintf(stderr, "The value of #rate should be positive\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            else if(!strcmp(argv[i], "--seed"))
+                seed = std::stoul(argv[i + 1]);
+            else {
+                fprintf(stderr, "unknown option \"%s\"\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
     }
     initializer init;
     pthread_t threads[53]{};  /* thread variables */
+    clock_gettime(CLOCK_REALTIME, &start);
     
     /* create threads 1 and 2 */
     pthread_create (&threads[0], NULL,  Prof_behavior, (void *) &pt_datas[0]);
@@ -159,6 +374,47 @@ int main(int argc, char* argv[]) {
     for(int i = 0; i < 53; ++i)
         if(threads[i])
             pthread_join(threads[i], NULL);
+
+    /* throughput and tail latency (enter -> leave) of this policy */
+    vector<long long> lat;
+    long long makespan = 0;
+    for(auto const& s : student_datas) {
+        lat.push_back(s.leave_ms - s.enter_ms);
+        makespan = std::max(makespan, s.leave_ms);
+    }
+    std::sort(lat.begin(), lat.end());
+    auto pct = [&lat](int p) { return lat[(lat.size() - 1) * p / 100]; };
+    printf("policy=%s seats=%d backoff=%s rate=%g/s: throughput %.2f students/s, latency p50 %lld ms, p95 %lld ms, p99 %lld ms, max %lld ms\n",
+        policy_names[policy], seat_num, backoff_names[backoff], arrival_rate, 50 * 1000.0 / std::max(makespan, 1LL),
+        pct(50), pct(95), pct(99), lat.back());
+
+    /* semaphore handoffs of every thread, and how far the discussions drifted from dis_time */
+    sem_stats_t students;
+    for(int i = 3; i < 53; ++i)
+        students.merge(sem_stats[i]);
+    auto print_sem = [](const char* who, sem_stats_t const& st) {
+        printf("%-9s %6lld waits %6lld blocked, signal-to-wake p50 < %7lld ns, p99 < %8lld ns, max %8lld ns, total %8.3f ms, in wait %9.1f ms\n",
+            who, st.waits, st.blocked, st.quantile(0.5), st.quantile(0.99), st.wake_max, st.wake_ns / 1e6, st.wait_ns / 1e6);
+    };
+    for(int i = 0; i <= TA_num; ++i)
+        print_sem(pt_datas[i].name.c_str(), sem_stats[i]);
+    print_sem("Students", students);
+    for(int k = 0; k < 2; ++k) {
+        long long intended = 0, real = 0, worst = 0;
+        int worst_sid = 0;
+        for(auto const& s : student_datas) {
+            long long want = (k ? s.Prof_time : s.TA_time) * 1'000'000LL;
+            intended += want;
+            real += s.talk_ns[k];
+            if(s.talk_ns[k] - want > worst) {
+                worst = s.talk_ns[k] - want;
+                worst_sid = s.sid;
+            }
+        }
+        printf("%-9s discussions: dis_time %lld ms, slept %.3f ms (+%.3f%%), overshoot mean %.3f ms, max %.3f ms (Student %.2d)\n",
+            k ? "Prof. TY" : "TA", intended / 1'000'000, real / 1e6, (real - intended) * 100.0 / intended,
+            (real - intended) / 50e6, worst / 1e6, worst_sid);
+    }
     /* exit */  
     exit(0);
 } /* main() */
@@ -168,7 +424,6 @@ int main(int argc, char* argv[]) {
  * print_message_function is used as the start routine for the threads used
  * it accepts a void pointer 
 **/
-static struct timespec start;
 long long clock_now_() {
     timespec t;
     clock_gettime(CLOCK_REALTIME, &t);
@@ -179,15 +434,27 @@ long long clock_now_() {
 void* student_behavior(void *ptr) {
     long long msec;
     student_data_t& data = *reinterpret_cast<student_data_t*>(ptr);  /* type cast to a pointer to thdata */
-    pthread_mutex_lock(&mutex_);
-    usleep(rnd(5, 10) * 1'000);
-    pthread_mutex_unlock(&mutex_);
+    seed_rng_(3 + data.sid);
+    data.TA_time = rnd(10, 30);
+    data.Prof_time = rnd(50, 100);
+    data.prio = rnd(0, 3);
+    /* sleep until the arrival time drawn in initializer, independent of the other students */
+    timespec arrive = start;
+    arrive.tv_sec += data.arrive_ns / 1'000'000'000;
+    arrive.tv_nsec += data.arrive_ns % 1'000'000'000;
+    if(arrive.tv_nsec >= 1'000'000'000) {
+        ++arrive.tv_sec;
+        arrive.tv_nsec -= 1'000'000'000;
+    }
+    while(clock_nanosleep(CLOCK_REALTIME, TIMER_ABSTIME, &arrive, NULL) == EINTR);
     
-    printf("%5lld ms -- Student %.2d: enter\n", clock_now_(), data.sid);
+    data.enter_ms = clock_now_();
+    printf("%5lld ms -- Student %.2d: enter\n", data.enter_ms, data.sid);
     /* do the work */
+    int retry = 0;
     while(!data.can_talk_with_TA) {
         pthread_mutex_lock(&TA_queue_mutex);
-        if(wait_TA_queue.size() < 5) {
+        if(wait_TA_queue->size() < (size_t)seat_num) {
             if(idle_TA_queue.size()) {
                 int TA_id = idle_TA_queue.front();
                 pt_datas[TA_id].ack.signal();          
@@ -195,18 +462,25 @@ void* student_behavior(void *ptr) {
             }
             data.can_talk_with_TA = true;
             printf("%5lld ms -- Student %.2d: wait TA\n", clock_now_(), data.sid);
-            wait_TA_queue.push(data.sid);
+            wait_TA_queue->push(data.sid);
             pthread_mutex_unlock(&TA_queue_mutex);
             data.ack.wait();
         }
+        else if(backoff == BLOCK_) {
+            printf("%5lld ms -- Student %.2d: wait for a free seat\n", clock_now_(), data.sid);
+            pthread_cond_wait(&seat_cond, &TA_queue_mutex);
+            pthread_mutex_unlock(&TA_queue_mutex);
+        }
         else {
-            long long msec = rnd(30, 50);
+            long long msec = backoff == EXP_ ? (30LL << std::min(retry++, 4)) + rnd(0, 20) : rnd(30, 50);
             printf("%5lld ms -- Student %.2d: go watching \"The Distance Between Us And The Hunger\" with TA S %lld ms\n", clock_now_(), data.sid, msec);
             pthread_mutex_unlock(&TA_queue_mutex);
             usleep(msec * 1'000);
         }
     }
+    long long t0 = mono_ns_();
     usleep(data.dis_time * 1'000);
+    data.talk_ns[0] = mono_ns_() - t0;
     data.had_talked_with_TA = true;
     pthread_mutex_lock(&Prof_queue_mutex);
     if(idle_Prof_queue.size()) {
@@ -214,7 +488,7 @@ void* student_behavior(void *ptr) {
         pt_datas[0].ack.signal();
         printf("%5lld ms -- Student %.2d: finish the discussion with %s\n", clock_now_(), data.sid, pt_datas[data.TA_id].name.c_str());
         idle_Prof_queue.pop();
-        wait_Prof_queue.push(data.sid);
+        wait_Prof_queue->push(data.sid);
         pthread_mutex_unlock(&Prof_queue_mutex);
         data.ack.wait();
     }
@@ -222,13 +496,13 @@ void* student_behavior(void *ptr) {
         pthread_mutex_unlock(&Prof_queue_mutex);
         pthread_mutex_lock(&TA_queue_mutex);
         pt_datas[data.TA_id].ack.signal(); // tell leave
-        wait_TA_queue.push(data.sid);
+        wait_TA_queue->push(data.sid);
         printf("%5lld ms -- Student %.2d: finish the discussion with %s and give up his/her seat\n", clock_now_(), data.sid, pt_datas[data.TA_id].name.c_str());
         pthread_mutex_unlock(&TA_queue_mutex);
         data.ack.wait();
         printf("%5lld ms -- Student %.2d: sit in front of %s and wait Prof. TY\n", clock_now_(), data.sid, pt_datas[data.TA_id].name.c_str());
         pthread_mutex_lock(&Prof_queue_mutex);
-        wait_Prof_queue.push(data.sid);
+        wait_Prof_queue->push(data.sid);
         if(idle_Prof_queue.size()) {
             pt_datas[0].ack.signal();
             idle_Prof_queue.pop();
@@ -238,17 +512,19 @@ void* student_behavior(void *ptr) {
         pt_datas[data.TA_id].ack.signal(); // tell leave
     }
 
+    t0 = mono_ns_();
     usleep(data.dis_time * 1'000);
-    printf("%5lld ms -- Student %.2d: finish the discussion with %s and leave\n", clock_now_(), data.sid, pt_datas[0].name.c_str());
+    data.talk_ns[1] = mono_ns_() - t0;
+    data.leave_ms = clock_now_();
+    printf("%5lld ms -- Student %.2d: finish the discussion with %s and leave\n", data.leave_ms, data.sid, pt_datas[0].name.c_str());
     pt_datas[0].ack.signal(); // tell leave
     pthread_exit(0); /* exit */
 } /* print_message_function ( void *ptr ) */
 
-decltype(auto) discuss_with_student(queue<int>& q, pthread_mutex_t& mut, int range_begin, int range_end, int who) {
-    auto& sdata = student_datas[q.front() - 1];
-    q.pop();
+decltype(auto) discuss_with_student(wait_queue_t& q, pthread_mutex_t& mut, int who) {
+    auto& sdata = student_datas[q.pop(who) - 1];
     pthread_mutex_unlock(&mut);
-    sdata.dis_time = rnd(range_begin, range_end);
+    sdata.dis_time = who ? sdata.TA_time : sdata.Prof_time;
     if(who)
         sdata.TA_id = who;
     sdata.ack.signal();
@@ -258,7 +534,7 @@ decltype(auto) discuss_with_student(queue<int>& q, pthread_mutex_t& mut, int ran
 void* Prof_behavior(void* ptr) {
     pt_data_t& data = *reinterpret_cast<pt_data_t*>(ptr);  /* type cast to a pointer to thdata */
 
-    clock_gettime(CLOCK_REALTIME, &start);
+    seed_rng_(data.tid);
     for(int i = 0; i < TA_num; ++i)
         pt_datas[i + 1].ack.signal();
     pthread_mutex_lock(&Prof_queue_mutex);
@@ -271,19 +547,19 @@ void* Prof_behavior(void* ptr) {
     while(s_num < 50) {
         data.ack.wait();
         pthread_mutex_lock(&Prof_queue_mutex);
-        if(wait_Prof_queue.empty()) {
+        if(wait_Prof_queue->empty()) {
             printf("%5lld ms -- %s: rest\n", clock_now_(), data.name.c_str());
             idle_Prof_queue.push(0);
             pthread_mutex_unlock(&Prof_queue_mutex);
         }
         else {
-            auto& sdata = discuss_with_student(wait_Prof_queue, Prof_queue_mutex, 50, 100, data.tid);
+            auto& sdata = discuss_with_student(*wait_Prof_queue, Prof_queue_mutex, data.tid);
             printf("%5lld ms -- %s: discuss with Student %.2d %d ms\n", clock_now_(), data.name.c_str(), sdata.sid, sdata.dis_time);
             ++s_num;
         }
     }
     
-    end_ = true;
+    end_.store(true, std::memory_order_release);
 
     for(int i = 0; i < TA_num; ++i)
         pt_datas[i + 1].ack.signal();
@@ -293,6 +569,7 @@ void* Prof_behavior(void* ptr) {
 
 void* TA_behavior(void* ptr) {
     pt_data_t& data = *reinterpret_cast<pt_data_t*>(ptr);  /* type cast to a pointer to thdata */
+    seed_rng_(data.tid);
     data.ack.wait();
     pthread_mutex_lock(&TA_queue_mutex);
     idle_TA_queue.push(data.tid);
@@ -301,16 +578,17 @@ void* TA_behavior(void* ptr) {
 
     while(true) {
         data.ack.wait();
-        if(end_)
+        if(end_.load(std::memory_order_acquire))
             break;
         pthread_mutex_lock(&TA_queue_mutex);
-        if(wait_TA_queue.empty()) {
+        if(wait_TA_queue->empty()) {
             printf("%5lld ms -- %s: rest\n", clock_now_(), data.name.c_str());
             idle_TA_queue.push(data.tid);
             pthread_mutex_unlock(&TA_queue_mutex);
         }
         else {
-            auto& sdata = discuss_with_student(wait_TA_queue, TA_queue_mutex, 10, 30, data.tid);
+            auto& sdata = discuss_with_student(*wait_TA_queue, TA_queue_mutex, data.tid);
+            pthread_cond_signal(&seat_cond);
             if(!sdata.had_talked_with_TA)
                 printf("%5lld ms -- %s: discuss with Student %.2d %d ms\n", clock_now_(), data.name.c_str(), sdata.sid, sdata.dis_time);
         }
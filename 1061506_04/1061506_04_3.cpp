@@ -1,3 +1,9 @@
+/*
+    compile: g++ -o prog4 1061506_04_3.cpp -std=c++17 -O2 -lpthread
+             (-march=native for the widest vector registers, -DRES_NUM=#n for another resource number)
+    exec: ./prog4 filename
+    input for benchmarks: gen_data.cpp, ./bench.sh runs --bench-file over growing process numbers
+*/
 #include <iostream>
 #include <fstream>
 #include <algorithm>
@@ -8,14 +14,95 @@
 #include <iterator>
 #include <functional>
 #include <iomanip>
+#include <numeric>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <memory>
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <charconv>
+#include <string_view>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 using namespace std;
 
 const bool debug_ = false;
 
 using gid_t_ = int;
 
-const int R_NUM = 5; // resource number
-using R_t = array<int, R_NUM>; // resource type
+#ifndef RES_NUM
+#define RES_NUM 5 // build with -DRES_NUM=64 for more resource classes
+#endif
+const int R_NUM = RES_NUM; // resource number
+
+#if defined(__AVX512F__)
+const int V_BYTES_ = 64; // 16 resources per instruction
+#elif defined(__AVX2__)
+const int V_BYTES_ = 32; // 8 resources per instruction
+#else
+const int V_BYTES_ = 16; // 4 resources per instruction (SSE2)
+#endif
+
+// resource vector of N ints, padded to whole vector registers so that +=, -= and <=
+// are one vector instruction per register (build with -march=native to get the widest one).
+// padding lanes are always 0.
+template<int N>
+struct res_t {
+	using v_t = int __attribute__((vector_size(V_BYTES_)));
+	static constexpr int LANE = V_BYTES_ / sizeof(int), V_NUM = (N + LANE - 1) / LANE;
+	alignas(V_BYTES_) int a[V_NUM * LANE] = {};
+
+	static v_t load_(int const* p) {
+		v_t v;
+		memcpy(&v, p, sizeof v);
+		return v;
+	}
+	static void store_(int* p, v_t v) {
+		memcpy(p, &v, sizeof v);
+	}
+
+	constexpr size_t size() const { return N; }
+	int& operator[](int i) { return a[i]; }
+	int operator[](int i) const { return a[i]; }
+	int* begin() { return a; }
+	int* end() { return a + N; }
+	int const* begin() const { return a; }
+	int const* end() const { return a + N; }
+
+	res_t& operator+=(res_t const& b) {
+		for (int k = 0; k < V_NUM * LANE; k += LANE)
+			store_(a + k, load_(a + k) + load_(b.a + k));
+		return *this;
+	}
+	res_t& operator-=(res_t const& b) {
+		for (int k = 0; k < V_NUM * LANE; k += LANE)
+			store_(a + k, load_(a + k) - load_(b.a + k));
+		return *this;
+	}
+	friend res_t operator+(res_t a, res_t const& b) {
+		return a += b;
+	}
+	friend res_t operator-(res_t a, res_t const& b) {
+		return a -= b;
+	}
+	friend bool operator<=(res_t const& a, res_t const& b) {
+		using m_t = long long __attribute__((vector_size(V_BYTES_)));
+		v_t gt = {};
+		for (int k = 0; k < V_NUM * LANE; k += LANE)
+			gt |= load_(a.a + k) > load_(b.a + k);
+		m_t m = (m_t)gt;
+		long long any = 0;
+		for (int i = 0; i < V_BYTES_ / 8; ++i)
+			any |= m[i];
+		return !any;
+	}
+};
+using R_t = res_t<R_NUM>; // resource type
 
 R_t available_;
 
@@ -27,14 +114,14 @@ const string ARR_NAME_[] = {
 	"#REQUEST",
 	"#AVAILABLE",
 };
-const int MAX_GID_ = 100;
+const int MAX_GID_ = 1 << 24; // gids must be in [0, MAX_GID_)
 int gid_num;
 
 struct req_t {
-	using op_t = string;
+	enum op_t : char { alloc_, rels_, };
 	gid_t_ gid = -1;
 	R_t resources = {};
-	op_t op;
+	op_t op = alloc_;
 	size_t size() const {
 		return R_NUM + 1;
 	}
@@ -45,23 +132,26 @@ struct req_t {
 			return resources[i - 1];
 	}
 };
-const req_t::op_t op_alloc = "allocate";
-const req_t::op_t op_rels = "release";
+const req_t::op_t op_alloc = req_t::alloc_;
+const req_t::op_t op_rels = req_t::rels_;
+const string OP_NAME_[] = {
+	"allocate",
+	"release",
+};
 R_t avail;
-map<gid_t_, R_t> datas[ARR_NUM_];
-vector<req_t> reqs, waiting_q;
+vector<pair<gid_t_, R_t> > rows_[ARR_NUM_]; // #MAX and #ALLOCATION lines as read
 
 using seq_t = vector<int>;
 
 template<typename C>
 struct print_all {
 	C const& cont_;
-	string begin_, sep_, end_;
+	char const *begin_, *sep_, *end_;
 	print_all(C const& cont)
 		: print_all::print_all(cont, "(", ", ", ")")
 	{}
 
-	print_all(C const& cont, string begin, string sep, string end)
+	print_all(C const& cont, char const* begin, char const* sep, char const* end)
 		: cont_(cont), begin_(begin), sep_(sep), end_(end)
 	{}
 
@@ -82,18 +172,94 @@ inline print_all<C> print_all_(C const& cont) {
 	return print_all<C>(cont);
 }
 
-void init_(string const& file) {
-	ifstream fin(file);
-	int64_t state_ = -1, c;
-	string s;
-	while ((c = fin.peek()) != EOF) {
+// the input file mapped in memory, parsed one line at a time with from_chars
+struct scanner_ {
+	char const *p, *end;
+	int line = 0;
+
+	void skip_blank_() {
+		while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+			++p;
+	}
+
+	bool int_(int& v) {
+		skip_blank_();
+		auto [q, ec] = from_chars(p, end, v);
+		if (ec != errc())
+			return false;
+		p = q;
+		return true;
+	}
+
+	bool res_(R_t& rs) {
+		for (auto& r : rs)
+			if (!int_(r))
+				return false;
+		return true;
+	}
+
+	string_view token_() {
+		skip_blank_();
+		auto b = p;
+		while (p < end && !isspace((unsigned char)*p))
+			++p;
+		return string_view(b, p - b);
+	}
+
+	// the rest of the current line, the cursor moves to the next one
+	string_view rest_() {
+		auto b = p;
+		p = find(p, end, '\n');
+		string_view s(b, p - b);
+		if (p < end)
+			++p;
+		++line;
+		while (!s.empty() && s.back() == '\r')
+			s.remove_suffix(1);
+		return s;
+	}
+
+	[[noreturn]] void fail_(string const& what) {
+		cerr << "invalid input format at line " << line + 1 << ": " << what << '\n';
+		exit(EXIT_FAILURE);
+	}
+};
+
+// streams the file: on_state() runs once every array before #REQUEST is read,
+// then on_request() runs for each request as soon as its line is parsed
+template<typename S, typename Q>
+void init_(string const& file, S&& on_state, Q&& on_request) {
+	int fd = open(file.c_str(), O_RDONLY);
+	struct stat st;
+	if (fd == -1 || fstat(fd, &st) == -1) {
+		cerr << "cannot open \"" << file << "\"\n";
+		exit(EXIT_FAILURE);
+	}
+	size_t len = st.st_size;
+	void* map = len ? mmap(NULL, len, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+	close(fd);
+	if (map == MAP_FAILED) {
+		cerr << "cannot map \"" << file << "\"\n";
+		exit(EXIT_FAILURE);
+	}
+	if (len)
+		madvise(map, len, MADV_SEQUENTIAL);
+
+	scanner_ sc{ (char const*)map, (char const*)map + len };
+	int64_t state_ = -1;
+	bool ready = false;
+	while (sc.p < sc.end) {
+		sc.skip_blank_();
+		char c = sc.p < sc.end ? *sc.p : '\n';
 		if (c == '/') {
-			if(debug_)
+			if (debug_)
 				clog << "comment\n";
-			getline(fin, s);
+			sc.rest_();
 		}
+		else if (c == '\n')
+			sc.rest_();
 		else if (c == '#') {
-			getline(fin, s);
+			auto s = sc.rest_();
 			state_ = find(begin(ARR_NAME_), end(ARR_NAME_), s) - begin(ARR_NAME_);
 			if (debug_)
 				clog << "array " << s << ' ' << state_ << "\n";
@@ -101,6 +267,8 @@ void init_(string const& file) {
 				cerr << "invalid array name \"" << s << "\"\n";
 				exit(EXIT_FAILURE);
 			}
+			if (ready && state_ != REQ_)
+				sc.fail_("\"" + string(s) + "\" after #REQUEST");
 		}
 		else {
 			if (debug_)
@@ -110,118 +278,353 @@ void init_(string const& file) {
 				exit(EXIT_FAILURE);
 			}
 			else if (state_ == AVAILABLE_) {
-				for (auto& r : avail)
-					fin >> r;
+				if (!sc.res_(avail))
+					sc.fail_("expect " + to_string(R_NUM) + " resources");
 			}
 			else if (state_ == REQ_) {
-				int gid;
-				R_t rs;
-				req_t::op_t op;
-				fin >> gid;
-				for (auto& r : rs)
-					fin >> r;
-				fin >> op;
+				req_t rq;
+				if (!sc.int_(rq.gid) || !sc.res_(rq.resources))
+					sc.fail_("expect gid and " + to_string(R_NUM) + " resources");
+				auto op = sc.token_();
 				if (op != "a" && op != "r") {
 					cerr << "invalid request operation " << op
 						<< "\nop must be a or r\n";
 					exit(EXIT_FAILURE);
 				}
-				else if (op == "a")
-					op = op_alloc;
-				else
-					op = op_rels;
-				reqs.push_back({ gid, rs, op });
+				rq.op = op == "a" ? op_alloc : op_rels;
+				if (!ready) {
+					on_state();
+					ready = true;
+				}
+				on_request(rq);
 			}
 			else {
-				int gid;
-				fin >> gid;
-				for (auto& r : datas[state_][gid])
-					fin >> r;
-				if (state_ == MAX_)
-					++gid_num;
+				gid_t_ gid;
+				R_t rs;
+				if (!sc.int_(gid) || !sc.res_(rs))
+					sc.fail_("expect gid and " + to_string(R_NUM) + " resources");
+				rows_[state_].push_back({ gid, rs });
 			}
-			getline(fin, s);
+			sc.rest_();
 		}
 	}
+	if (!ready)
+		on_state();
+	if (len)
+		munmap(map, len);
 }
 
-R_t& operator+=(R_t& a, R_t const& b) {
-	for (int i = 0; i < a.size(); ++i)
-		a[i] += b[i];
-	return a;
-}
+// dense state table
+// gids are remapped to 0..n-1 in ascending order, max, alloc and need are contiguous
+// rows indexed by that dense index, so a lookup is one array access instead of a tree search.
+struct state_table_ {
+	vector<gid_t_> gids;  // dense index -> gid
+	vector<int> index_;   // gid -> dense index, -1 for unknown gids
+	vector<R_t> max, alloc, need;
 
-R_t operator+(R_t const& a, R_t const& b) {
-	R_t tmp = a;
-	return tmp += b;
-}
+	int size() const {
+		return gids.size();
+	}
+
+	// dense index of gid, -1 if the gid has no #MAX line
+	int find(gid_t_ gid) const {
+		return gid >= 0 && gid < (int)index_.size() ? index_[gid] : -1;
+	}
+
+	void build(vector<pair<gid_t_, R_t> > const& max_rows, vector<pair<gid_t_, R_t> > const& alloc_rows) {
+		gids.clear();
+		for (auto const&[gid, r] : max_rows) {
+			if (gid < 0 || gid >= MAX_GID_) {
+				cerr << "Error: gid " << gid << " out of range [0, " << MAX_GID_ << ")\n";
+				exit(EXIT_FAILURE);
+			}
+			gids.push_back(gid);
+		}
+		sort(begin(gids), end(gids));
+		if (adjacent_find(begin(gids), end(gids)) != end(gids)) {
+			cerr << "Error: gid " << *adjacent_find(begin(gids), end(gids)) << " has more than one #MAX line\n";
+			exit(EXIT_FAILURE);
+		}
+		index_.assign(gids.empty() ? 0 : gids.back() + 1, -1);
+		for (int i = 0; i < size(); ++i)
+			index_[gids[i]] = i;
+
+		max.assign(size(), R_t{});
+		alloc.assign(size(), R_t{});
+		need.resize(size());
+		for (auto const&[gid, r] : max_rows)
+			max[find(gid)] = r;
+		for (auto const&[gid, r] : alloc_rows) {
+			int i = find(gid);
+			if (!~i) {
+				cerr << "Error: gid " << gid << " in #ALLOCATION has no #MAX line\n";
+				exit(EXIT_FAILURE);
+			}
+			alloc[i] = r;
+		}
+		for (int i = 0; i < size(); ++i) {
+			auto const& check = (need[i] = max[i] - alloc[i]);
+			if (any_of(begin(check), end(check),
+				[](auto r)->bool { return r < 0; })) {
+				cerr << "Error: gid " << gids[i] << " max < allocate\n"
+					"     max: " << print_all_(max[i]) << "\n"
+					"allocate: " << print_all_(alloc[i]) << "\n\n";
+				exit(EXIT_FAILURE);
+			}
+		}
+	}
+} table_;
+
+// incremental safety checker
+// reads need and alloc from a state_table_, every resource keeps the processes
+// sorted by their need of it.
+// a check only advances one pointer per resource while AVAILABLE grows, a process
+// becomes runnable when all of its R_NUM counters are satisfied, so one check is
+// O(n * R_NUM + n log n) and nothing is copied per request.
+struct safety_checker_ {
+	state_table_ const* tab = nullptr;
+	array<vector<int>, R_NUM> order, pos; // per resource: indexes sorted by need, and the position of each index
+	vector<int> cnt, ready; // scratch buffers reused by every check
+	array<int, R_NUM> ptr_; // where each resource's pointer stopped in the last check
+	long long check_num = 0;
+
+	void build(state_table_ const& t) {
+		tab = &t;
+		int n = t.size();
+		for (int r = 0; r < R_NUM; ++r) {
+			auto& o = order[r];
+			o.resize(n);
+			iota(begin(o), end(o), 0);
+			sort(begin(o), end(o), [&](int a, int b) { return less_(r, a, b); });
+			pos[r].resize(n);
+			for (int k = 0; k < n; ++k)
+				pos[r][o[k]] = k;
+		}
+		cnt.resize(n);
+		ready.reserve(n);
+	}
+
+	bool less_(int r, int a, int b) const {
+		auto const& need = tab->need;
+		return need[a][r] < need[b][r] || (need[a][r] == need[b][r] && a < b);
+	}
+
+	// need of dense index i has changed in the table
+	void update(int i) {
+		for (int r = 0; r < R_NUM; ++r) {
+			auto& o = order[r];
+			auto& p = pos[r];
+			int k = p[i];
+			for (; k > 0 && less_(r, i, o[k - 1]); --k)
+				p[o[k] = o[k - 1]] = k;
+			for (; k + 1 < (int)o.size() && less_(r, o[k + 1], i); ++k)
+				p[o[k] = o[k + 1]] = k;
+			p[o[k] = i] = k;
+		}
+	}
+
+	seq_t check(R_t av, req_t const& rq = {}) {
+		auto const& need = tab->need;
+		auto const& alloc = tab->alloc;
+		auto const& gids = tab->gids;
+		int n = gids.size();
+		bool trace = ~rq.gid && cout.good(); // no formatting when the output is discarded
+		seq_t safe_s;
+		auto& ptr = ptr_;
+		ptr.fill(0);
+		++check_num;
+		fill(begin(cnt), end(cnt), 0);
+		ready.clear();
+		auto advance = [&] {
+			for (int r = 0; r < R_NUM; ++r)
+				for (auto& k = ptr[r]; k < n && need[order[r][k]][r] <= av[r]; ++k) {
+					int i = order[r][k];
+					if (++cnt[i] == R_NUM) {
+						ready.push_back(i);
+						push_heap(begin(ready), end(ready), greater<int>());
+					}
+				}
+		};
+
+		if (trace)
+			cout << print_all_(rq) << ": AVAILABLE = " << print_all_(av) << '\n';
+		for (advance(); !ready.empty(); advance()) {
+			// the smallest runnable gid, the same choice as rescanning from the start
+			pop_heap(begin(ready), end(ready), greater<int>());
+			int i = ready.back();
+			ready.pop_back();
+			av -= need[i];
+			if (trace)
+				cout << print_all_(rq) << ": gid " << gids[i] << " execute: -" << print_all_(need[i]) << "   AVAILABLE = " << print_all_(av) << '\n';
+			av += alloc[i] + need[i];
+			if (trace)
+				cout << print_all_(rq) << ": gid " << gids[i] << " finish:  +" << print_all_(alloc[i] + need[i]) << "   AVAILABLE = " << print_all_(av) << '\n';
+			safe_s.push_back(gids[i]);
+		}
+
+		return safe_s;
+	}
+
+	// resources some unfinished process still lacked when the last check got stuck
+	vector<int> stuck_keys() const {
+		vector<int> keys;
+		for (int r = 0; r < R_NUM; ++r)
+			if (ptr_[r] < tab->size())
+				keys.push_back(r);
+		return keys;
+	}
+} checker_;
 
-R_t& operator-=(R_t& a, R_t const& b) {
-	for (int i = 0; i < a.size(); ++i)
-		a[i] -= b[i];
-	return a;
+seq_t is_safety_(R_t const& av, req_t const& rq = {}) {
+	return checker_.check(av, rq);
 }
 
-R_t operator-(R_t const& a, R_t const& b) {
-	R_t tmp = a;
-	return tmp -= b;
+// i is the dense index of rq.gid
+void grant_(int i, req_t const& rq) {
+	avail -= rq.resources;
+	table_.alloc[i] += rq.resources;
+	table_.need[i] -= rq.resources;
+	checker_.update(i);
 }
 
-bool operator<=(R_t const& a, R_t const& b) {
-	auto it = b.begin();
-	return all_of(begin(a), end(a),
-		[&it](auto r)->bool {
-		return r <= *it++;
-	});
+void revoke_(int i, req_t const& rq) {
+	avail += rq.resources;
+	table_.alloc[i] -= rq.resources;
+	table_.need[i] += rq.resources;
+	checker_.update(i);
 }
 
-seq_t is_safety_(R_t av, map<gid_t_, R_t> al, map<gid_t_, R_t> max, req_t rq = {}) {
-	map<gid_t_, bool> fin{};
-	seq_t safe_s;
-	auto need = map<gid_t_, R_t>{};
-	for (auto const&[id, r] : al) {
-		fin[id] = false;
-		auto const& check = (need[id] = max[id] - r);
-		if (any_of(begin(check), end(check),
-			[](auto r)->bool { return r < 0; })) {
-			cerr << "Error: gid " << id << " max < allocate\n"
-				"     max: " << print_all_(max[id]) << "\n"
-				"allocate: " << print_all_(al[id]) << "\n\n";
+// allocation requests submitted and granted, in total and per dense index
+struct stats_t {
+	long long submitted = 0, granted = 0;
+	vector<int> sub, got;
+
+	void submit(int i) {
+		++submitted;
+		++sub[i];
+	}
+	void grant(int i) {
+		++granted;
+		++got[i];
+	}
+
+	// Jain's index over the share of each process's requests that got granted, 1 is perfectly fair
+	double fairness() const {
+		double sum = 0, sq = 0;
+		int n = 0;
+		for (int i = 0; i < (int)sub.size(); ++i)
+			if (sub[i]) {
+				double x = (double)got[i] / sub[i];
+				sum += x;
+				sq += x * x;
+				++n;
+			}
+		return sq ? sum * sum / (n * sq) : 1.0;
+	}
+} stats_;
+
+// output modes
+// human: the full trace on cout (default). lines: one buffered line per decision.
+// quiet: only a summary at the end. --binlog additionally writes every decision
+// as a fixed size binary record.
+enum out_mode_t { human_, lines_, quiet_, };
+out_mode_t out_mode_ = human_;
+
+enum dec_t : uint8_t { granted_, unsafe_, short_, invalid_, unknown_, aborted_, };
+const char* DEC_NAME_[] = {
+	"granted",
+	"unsafe",
+	"short",
+	"invalid",
+	"unknown",
+	"aborted",
+};
+
+// binary log layout: "BNKL", int32 R_NUM, then one rec_t per decision
+struct decision_log_ {
+	struct rec_t {
+		int32_t gid;
+		uint8_t op, dec, retry, pad;
+		int32_t res[R_NUM];
+	};
+	FILE *bin = nullptr, *txt = nullptr;
+	vector<char> bin_buf, txt_buf;
+	array<long long, 6> count{};
+
+	void open_bin(string const& file) {
+		if (!(bin = fopen(file.c_str(), "wb"))) {
+			cerr << "cannot open \"" << file << "\"\n";
 			exit(EXIT_FAILURE);
 		}
+		int32_t r = R_NUM;
+		fwrite("BNKL", 1, 4, bin);
+		fwrite(&r, sizeof r, 1, bin);
 	}
 
-	if (~rq.gid)
-			cout << print_all_(rq) << ": AVAILABLE = " << print_all_(av) << '\n';
-	while (any_of(begin(fin), end(fin),
-		[](auto p)->bool { return p.second == false; })) {
-		int gid = -1;
-		R_t res{};
-		for (auto const&[id, r] : need)
-			if (!fin[id] && r <= av) {
-				gid = id;
-				res = r;
-				break;
+	void decide(req_t const& rq, dec_t d, bool retry = false) {
+		++count[d];
+		if (bin) {
+			rec_t rec{ rq.gid, (uint8_t)rq.op, d, retry, 0, {} };
+			copy(begin(rq.resources), end(rq.resources), rec.res);
+			auto p = (char const*)&rec;
+			bin_buf.insert(end(bin_buf), p, p + sizeof rec);
+			if (bin_buf.size() >= 1 << 20)
+				flush_(bin, bin_buf);
+		}
+		if (txt) {
+			// gid op r0 r1 ... decision [retry]
+			char line[32 + 12 * R_NUM], *p = line, *e = line + sizeof line;
+			p = to_chars(p, e, rq.gid).ptr;
+			*p++ = ' ';
+			*p++ = OP_NAME_[rq.op][0];
+			for (auto r : rq.resources) {
+				*p++ = ' ';
+				p = to_chars(p, e, r).ptr;
 			}
-		if (!~gid)
-			break;
-		av -= res;
-		auto alloc = al[gid] + res;
-		if (~rq.gid)
-			cout << print_all_(rq) << ": gid " << gid << " execute: -" << print_all_(res) << "   AVAILABLE = " << print_all_(av) << '\n';
-		av += alloc;
-		fin[gid] = true;
-		if (~rq.gid)
-			cout << print_all_(rq) << ": gid " << gid << " finish:  +" << print_all_(alloc) << "   AVAILABLE = " << print_all_(av) << '\n';
-		safe_s.push_back(gid);
-	}
-
-	return move(safe_s);
+			*p++ = ' ';
+			p = copy_n(DEC_NAME_[d], strlen(DEC_NAME_[d]), p);
+			if (retry)
+				p = copy_n(" retry", 6, p);
+			*p++ = '\n';
+			txt_buf.insert(end(txt_buf), line, p);
+			if (txt_buf.size() >= 1 << 20)
+				flush_(txt, txt_buf);
+		}
+	}
+
+	void flush_(FILE* f, vector<char>& buf) {
+		fwrite(buf.data(), 1, buf.size(), f);
+		buf.clear();
+	}
+
+	void close() {
+		if (bin) {
+			flush_(bin, bin_buf);
+			fclose(bin);
+			bin = nullptr;
+		}
+		if (txt) {
+			flush_(txt, txt_buf);
+			fflush(txt);
+			txt = nullptr;
+		}
+	}
+} log_;
+
+// table, checker and statistics for a new state, every entry point builds its state here
+void build_state_(vector<pair<gid_t_, R_t> > const& max_rows, vector<pair<gid_t_, R_t> > const& alloc_rows) {
+	table_.build(max_rows, alloc_rows);
+	gid_num = table_.size();
+	checker_.build(table_);
+	stats_ = stats_t{};
+	stats_.sub.assign(gid_num, 0);
+	stats_.got.assign(gid_num, 0);
 }
 
 void determine_init() {
 	seq_t ss;
-	ss = is_safety_(avail, datas[ALLOC_], datas[MAX_]);
+	build_state_(rows_[MAX_], rows_[ALLOC_]);
+	ss = is_safety_(avail);
 	cout << "Initial state: ";
 	if (ss.size() < gid_num)
 		cout << "unsafe\n";
@@ -229,85 +632,1024 @@ void determine_init() {
 		cout << "safe, safe sequence = " << print_all_(ss) << '\n';
 }
 
-int main(int argc, char* argv[]) {
-	if (argc != 2) {
-		cerr << "No input files or too many input files!\n";
-		exit(EXIT_FAILURE);
+// cost of the lookup every request does, need of gid, map<gid_t_, R_t> vs state_table_
+void bench_lookup_(int n) {
+	mt19937 rng(n);
+	vector<pair<gid_t_, R_t> > max_rows, alloc_rows;
+	map<gid_t_, R_t> max, alloc;
+	for (int gid = 0; gid < n; ++gid) {
+		R_t m, a;
+		for (int r = 0; r < R_NUM; ++r)
+			a[r] = rng() % ((m[r] = rng() % 10) + 1);
+		max_rows.push_back({ gid, m });
+		alloc_rows.push_back({ gid, a });
+		max[gid] = m;
+		alloc[gid] = a;
 	}
-	init_(argv[1]);
-	
-	determine_init();
-	
-	seq_t ss;
-	for (auto& rq : reqs) {
-		cout << "gid " << rq.gid << ' ' << rq.op
-			<< ' ' << print_all_(rq.resources) << ":\n";
-		if (rq.op == op_alloc) {
-			if (rq.resources <= datas[MAX_][rq.gid] - datas[ALLOC_][rq.gid]) {
-				if (rq.resources <= avail) {
-					avail -= rq.resources;
-					datas[ALLOC_][rq.gid] += rq.resources;
-					ss = is_safety_(avail, datas[ALLOC_], datas[MAX_], rq);
-					if (ss.size() == gid_num)
-						cout << "granted, safe sequence = " << print_all_(ss) << '\n';
-					else {
-						avail += rq.resources;
-						datas[ALLOC_][rq.gid] -= rq.resources;
-						cout << "unsafe, must wait\n";
-						waiting_q.push_back(rq);
+	state_table_ t;
+	t.build(max_rows, alloc_rows);
+
+	const int LOOKUP_NUM = 2'000'000;
+	vector<gid_t_> keys(LOOKUP_NUM);
+	for (auto& k : keys)
+		k = rng() % n;
+	auto time_ = [&](auto&& need_of) {
+		volatile int sum = 0;	// keeps the timed loop
+		auto t0 = chrono::steady_clock::now();
+		for (auto k : keys)
+			sum += need_of(k)[0];
+		auto t1 = chrono::steady_clock::now();
+		return chrono::duration<double, nano>(t1 - t0).count() / LOOKUP_NUM;
+	};
+	double map_ns = time_([&](gid_t_ gid) { return max[gid] - alloc[gid]; });
+	double table_ns = time_([&](gid_t_ gid) -> R_t const& { return t.need[t.find(gid)]; });
+	cout << "lookup n = " << setw(8) << n << ": map " << fixed << setprecision(2) << setw(8) << map_ns
+		<< " ns, table " << setw(6) << table_ns << " ns, " << map_ns / table_ns << "x\n" << defaultfloat;
+}
+
+// waiting requests, indexed by the resources that block them
+// a request short of resources is filed under one resource it lacks, it cannot fit before
+// that one is released. an unsafe request is filed under every resource the stuck safety
+// run lacked: a release touching none of them leaves it unsafe, and grants never make an
+// unsafe request safe. so a release only retries the requests filed under what it returns.
+struct wait_index_ {
+	struct entry_t {
+		req_t rq;
+		long long seq;               // arrival order, retries keep the FIFO order
+		vector<pair<int, int> > at;  // (resource, slot in that resource's bucket)
+		long long stamp = -1;
+	};
+	vector<entry_t> pool;
+	vector<int> free_;
+	array<vector<int>, R_NUM> buckets;
+	long long seq = 0, stamp = 0;
+	int size_ = 0;
+	bool rescan_all = false; // retry every waiting request on each release (the old behavior)
+
+	int size() const {
+		return size_;
+	}
+
+	int push(req_t const& rq, vector<int> const& keys) {
+		int e;
+		if (free_.empty()) {
+			e = pool.size();
+			pool.emplace_back();
+		}
+		else {
+			e = free_.back();
+			free_.pop_back();
+		}
+		pool[e].rq = rq;
+		pool[e].seq = seq++;
+		file_(e, keys);
+		++size_;
+		return e;
+	}
+
+	// e is still blocked, by keys now
+	void refile(int e, vector<int> const& keys) {
+		unfile_(e);
+		file_(e, keys);
+	}
+
+	void erase(int e) {
+		unfile_(e);
+		free_.push_back(e);
+		--size_;
+	}
+
+	// requests a release of res could unblock, in arrival order
+	vector<int> candidates(R_t const& res) {
+		vector<int> c;
+		++stamp;
+		for (int r = 0; r < R_NUM; ++r)
+			if (rescan_all || res[r] > 0)
+				for (int e : buckets[r])
+					if (pool[e].stamp != stamp) {
+						pool[e].stamp = stamp;
+						c.push_back(e);
 					}
+		sort(begin(c), end(c), [this](int a, int b) { return pool[a].seq < pool[b].seq; });
+		return c;
+	}
+
+	void file_(int e, vector<int> const& keys) {
+		auto& at = pool[e].at;
+		at.clear();
+		for (int r : keys) {
+			at.push_back({ r, (int)buckets[r].size() });
+			buckets[r].push_back(e);
+		}
+	}
+
+	// O(1) per bucket: the last entry of the bucket takes the freed slot
+	void unfile_(int e) {
+		for (auto [r, slot] : pool[e].at) {
+			auto& b = buckets[r];
+			int moved = b[slot] = b.back();
+			b.pop_back();
+			for (auto& p : pool[moved].at)
+				if (p.first == r && moved != e)
+					p.second = slot;
+		}
+		pool[e].at.clear();
+	}
+} waiting_;
+
+// the resource rq still lacks
+vector<int> short_keys_(req_t const& rq) {
+	for (int r = 0; r < R_NUM; ++r)
+		if (rq.resources[r] > avail[r])
+			return { r };
+	return {};
+}
+
+void handle_(req_t const& rq) {
+	seq_t ss;
+	cout << "gid " << rq.gid << ' ' << OP_NAME_[rq.op]
+		<< ' ' << print_all_(rq.resources) << ":\n";
+	int i = table_.find(rq.gid);
+	if (!~i) {
+		log_.decide(rq, unknown_);
+		cout << "unknown gid, not granted\n";
+	}
+	else if (rq.op == op_alloc) {
+		stats_.submit(i);
+		if (rq.resources <= table_.need[i]) {
+			if (rq.resources <= avail) {
+				grant_(i, rq);
+				ss = is_safety_(avail, rq);
+				if (ss.size() == gid_num) {
+					stats_.grant(i);
+					log_.decide(rq, granted_);
+					cout << "granted, safe sequence = " << print_all_(ss) << '\n';
 				}
 				else {
-					cout << "not enough resouces, must wait\n";
-					waiting_q.push_back(rq);
+					auto keys = checker_.stuck_keys();
+					revoke_(i, rq);
+					log_.decide(rq, unsafe_);
+					cout << "unsafe, must wait\n";
+					waiting_.push(rq, keys);
 				}
 			}
 			else {
-				cout << "invalid request, not granted\n";
+				log_.decide(rq, short_);
+				cout << "not enough resouces, must wait\n";
+				waiting_.push(rq, short_keys_(rq));
 			}
 		}
-		else { // release
-			if (rq.resources <= datas[ALLOC_][rq.gid]) {
-				datas[ALLOC_][rq.gid] -= rq.resources;
-				avail += rq.resources;
-				cout << "granted\n\nCheck waiting request:\n";
-				for (auto it = begin(waiting_q); it != end(waiting_q);) {
-					auto& rq = *it;
-					cout << "gid " << rq.gid << ' ' << rq.op
-						<< ' ' << print_all_(rq.resources) << ":\n";
-					if (rq.resources <= datas[MAX_][rq.gid] - datas[ALLOC_][rq.gid]) {
-						if (rq.resources <= avail) {
-							avail -= rq.resources;
-							datas[ALLOC_][rq.gid] += rq.resources;
-							ss = is_safety_(avail, datas[ALLOC_], datas[MAX_], rq);
-							if (ss.size() == gid_num) {
-								cout << "granted, safe sequence = " << print_all_(ss) << '\n';
-								it = waiting_q.erase(it);
-							}
-							else {
-								avail += rq.resources;
-								datas[ALLOC_][rq.gid] -= rq.resources;
-								cout << "unsafe, must wait\n";
-								++it;
-							}
+		else {
+			log_.decide(rq, invalid_);
+			cout << "invalid request, not granted\n";
+		}
+	}
+	else { // release
+		if (rq.resources <= table_.alloc[i]) {
+			revoke_(i, rq);
+			log_.decide(rq, granted_);
+			cout << "granted\n\nCheck waiting request:\n";
+			for (int e : waiting_.candidates(rq.resources)) {
+				auto& rq = waiting_.pool[e].rq;
+				int i = table_.find(rq.gid);
+				cout << "gid " << rq.gid << ' ' << OP_NAME_[rq.op]
+					<< ' ' << print_all_(rq.resources) << ":\n";
+				if (rq.resources <= table_.need[i]) {
+					if (rq.resources <= avail) {
+						grant_(i, rq);
+						ss = is_safety_(avail, rq);
+						if (ss.size() == gid_num) {
+							stats_.grant(i);
+							log_.decide(rq, granted_, true);
+							cout << "granted, safe sequence = " << print_all_(ss) << '\n';
+							waiting_.erase(e);
 						}
 						else {
-							cout << "not enough resouces, must wait\n";
-							++it;
+							auto keys = checker_.stuck_keys();
+							revoke_(i, rq);
+							log_.decide(rq, unsafe_, true);
+							cout << "unsafe, must wait\n";
+							waiting_.refile(e, keys);
 						}
 					}
 					else {
-						cout << "invalid request, not granted\n";
-						it = waiting_q.erase(it);
+						log_.decide(rq, short_, true);
+						cout << "not enough resouces, must wait\n";
+						waiting_.refile(e, short_keys_(rq));
 					}
-					cout << "\nAVAILABLE = " << print_all_(avail) << "\n\n";
 				}
-				cout << "finish checking\n";
+				else {
+					log_.decide(rq, invalid_, true);
+					cout << "invalid request, not granted\n";
+					waiting_.erase(e);
+				}
+				cout << "\nAVAILABLE = " << print_all_(avail) << "\n\n";
 			}
-			else {
-				cout << "invalid request, not granted\n";
+			cout << "finish checking\n";
+		}
+		else {
+			log_.decide(rq, invalid_);
+			cout << "invalid request, not granted\n";
+		}
+	}
+	cout << "\nAVAILABLE = " << print_all_(avail) << "\n\n";
+}
+
+// deadlock detection (--detect)
+// allocations are granted whenever they fit AVAILABLE and need, with no safety check, so the
+// state may turn unsafe and deadlock. a request that doesn't fit waits and becomes a request
+// edge of its process in the resource allocation graph: wants[i] sums the waiting requests
+// of i and is kept up to date on every wait, grant and abort, only processes with waiting
+// requests are in blocked. every period requests the graph is reduced: a process that waits
+// for nothing can finish and return its allocation, what the others return is total minus
+// the allocations of the blocked ones. a blocked process whose wants fit that can finish too,
+// the ones left are deadlocked. the deadlocked process holding the most is the victim: its
+// waiting requests are dropped and its allocation released, until no deadlock remains.
+// one run is O(b^2) in the b blocked processes and doesn't touch the others.
+struct deadlock_detector_ {
+	int period = 0; // 0: avoidance
+	long long req_num = 0, run_num = 0;
+	R_t total{}; // AVAILABLE + every allocation, grants and releases only move resources between them
+	vector<R_t> wants;
+	vector<vector<int> > pend; // waiting entries of each process
+	vector<int> blocked, at;   // processes with waiting requests, and the slot of each in blocked (-1: none)
+	vector<gid_t_> victims;
+
+	void build(state_table_ const& t) {
+		total = avail;
+		for (auto const& a : t.alloc)
+			total += a;
+		wants.assign(t.size(), R_t{});
+		pend.assign(t.size(), {});
+		blocked.clear();
+		at.assign(t.size(), -1);
+	}
+
+	void wait(int i, int e) {
+		if (pend[i].empty()) {
+			at[i] = blocked.size();
+			blocked.push_back(i);
+		}
+		pend[i].push_back(e);
+		wants[i] += waiting_.pool[e].rq.resources;
+	}
+
+	// e is granted or dropped
+	void unwait(int i, int e) {
+		auto& p = pend[i];
+		p.erase(find(begin(p), end(p), e));
+		wants[i] -= waiting_.pool[e].rq.resources;
+		if (p.empty()) {
+			int moved = blocked[at[i]] = blocked.back();
+			at[moved] = at[i];
+			blocked.pop_back();
+			at[i] = -1;
+		}
+	}
+
+	vector<int> deadlocked() const {
+		R_t work = total;
+		for (int i : blocked)
+			work -= table_.alloc[i];
+		vector<int> left = blocked;
+		for (bool progress = true; progress; ) {
+			progress = false;
+			for (int k = 0; k < (int)left.size(); )
+				if (wants[left[k]] <= work) {
+					work += table_.alloc[left[k]];
+					left[k] = left.back();
+					left.pop_back();
+					progress = true;
+				}
+				else
+					++k;
+		}
+		sort(begin(left), end(left));
+		return left;
+	}
+} detector_;
+
+// retries the waiting requests a release of res could unblock, detection mode
+void detect_retry_(R_t const& res) {
+	for (int e : waiting_.candidates(res)) {
+		auto& rq = waiting_.pool[e].rq;
+		int i = table_.find(rq.gid);
+		cout << "gid " << rq.gid << ' ' << OP_NAME_[rq.op]
+			<< ' ' << print_all_(rq.resources) << ":\n";
+		if (!(rq.resources <= table_.need[i])) {
+			log_.decide(rq, invalid_, true);
+			cout << "invalid request, not granted\n";
+			detector_.unwait(i, e);
+			waiting_.erase(e);
+		}
+		else if (rq.resources <= avail) {
+			grant_(i, rq);
+			stats_.grant(i);
+			log_.decide(rq, granted_, true);
+			cout << "granted\n";
+			detector_.unwait(i, e);
+			waiting_.erase(e);
+		}
+		else {
+			log_.decide(rq, short_, true);
+			cout << "not enough resouces, must wait\n";
+			waiting_.refile(e, short_keys_(rq));
+		}
+	}
+}
+
+void detect_() {
+	++detector_.run_num;
+	for (auto dl = detector_.deadlocked(); !dl.empty(); dl = detector_.deadlocked()) {
+		auto held = [](int i) {
+			return accumulate(begin(table_.alloc[i]), end(table_.alloc[i]), 0LL);
+		};
+		int v = dl[0];
+		cout << "deadlock: gid";
+		for (int i : dl) {
+			cout << ' ' << table_.gids[i];
+			if (held(i) > held(v))
+				v = i;
+		}
+		req_t rq{ table_.gids[v], table_.alloc[v], op_rels };
+		cout << "\nabort gid " << rq.gid << ", release " << print_all_(rq.resources) << '\n';
+		detector_.victims.push_back(rq.gid);
+		for (int e : vector<int>(detector_.pend[v])) {
+			log_.decide(waiting_.pool[e].rq, aborted_, true);
+			detector_.unwait(v, e);
+			waiting_.erase(e);
+		}
+		revoke_(v, rq);
+		detect_retry_(rq.resources);
+	}
+}
+
+void detect_handle_(req_t const& rq) {
+	cout << "gid " << rq.gid << ' ' << OP_NAME_[rq.op]
+		<< ' ' << print_all_(rq.resources) << ":\n";
+	int i = table_.find(rq.gid);
+	if (!~i) {
+		log_.decide(rq, unknown_);
+		cout << "unknown gid, not granted\n";
+	}
+	else if (rq.op == op_alloc) {
+		stats_.submit(i);
+		if (!(rq.resources <= table_.need[i])) {
+			log_.decide(rq, invalid_);
+			cout << "invalid request, not granted\n";
+		}
+		else if (rq.resources <= avail) {
+			grant_(i, rq);
+			stats_.grant(i);
+			log_.decide(rq, granted_);
+			cout << "granted\n";
+		}
+		else {
+			log_.decide(rq, short_);
+			cout << "not enough resouces, must wait\n";
+			detector_.wait(i, waiting_.push(rq, short_keys_(rq)));
+		}
+	}
+	else { // release
+		if (rq.resources <= table_.alloc[i]) {
+			revoke_(i, rq);
+			log_.decide(rq, granted_);
+			cout << "granted\n\nCheck waiting request:\n";
+			detect_retry_(rq.resources);
+			cout << "finish checking\n";
+		}
+		else {
+			log_.decide(rq, invalid_);
+			cout << "invalid request, not granted\n";
+		}
+	}
+	if (++detector_.req_num % detector_.period == 0)
+		detect_();
+	cout << "\nAVAILABLE = " << print_all_(avail) << "\n\n";
+}
+
+// batch admission
+// allocations are collected until batch_size_ of them are pending (or a release comes in)
+// and admitted together: the largest prefix of the batch, smallest demand first, that keeps
+// the state safe. granting less never turns a safe state unsafe, so the prefix is found by
+// a binary search with one safety check per candidate set instead of one per request.
+// a request past the prefix may still be safe alone, so the rest of the batch is then
+// tried one by one in the same order, like handle_ would.
+int batch_size_ = 0; // --batch, 0: one request at a time without statistics
+vector<req_t> batch_;
+
+void flush_batch_() {
+	if (batch_.empty())
+		return;
+	vector<int> cand, idx(batch_.size());
+	for (int k = 0; k < (int)batch_.size(); ++k) {
+		auto const& rq = batch_[k];
+		idx[k] = table_.find(rq.gid);
+		if (~idx[k]) {
+			stats_.submit(idx[k]);
+			if (rq.resources <= table_.need[idx[k]])
+				cand.push_back(k);
+		}
+	}
+	auto demand = [&](int k) {
+		return accumulate(begin(batch_[k].resources), end(batch_[k].resources), 0LL);
+	};
+	stable_sort(begin(cand), end(cand), [&](int a, int b) { return demand(a) < demand(b); });
+
+	auto apply = [&](int p, bool grant) {
+		for (int j = 0; j < p; ++j)
+			if (grant)
+				grant_(idx[cand[j]], batch_[cand[j]]);
+			else
+				revoke_(idx[cand[j]], batch_[cand[j]]);
+	};
+	// the first p candidates fit AVAILABLE and every need, and leave the state safe
+	seq_t best_ss, ss;
+	auto safe_with = [&](int p) {
+		apply(p, true);
+		auto nonneg = [](R_t const& r) { return R_t{} <= r; };
+		bool ok = nonneg(avail);
+		for (int j = 0; j < p && ok; ++j)
+			ok = nonneg(table_.need[idx[cand[j]]]);
+		if (ok)
+			ok = (ss = is_safety_(avail)).size() == (size_t)gid_num;
+		apply(p, false);
+		return ok;
+	};
+	int lo = 0, hi = cand.size();
+	while (lo < hi) {
+		int mid = (lo + hi + 1) / 2;
+		if (safe_with(mid)) {
+			lo = mid;
+			best_ss = ss;
+		}
+		else
+			hi = mid - 1;
+	}
+	apply(lo, true);
+
+	vector<bool> granted(batch_.size());
+	for (int j = 0; j < lo; ++j)
+		granted[cand[j]] = true;
+	for (int j = lo; j < (int)cand.size(); ++j) {
+		int i = idx[cand[j]];
+		auto const& rq = batch_[cand[j]];
+		if (!(rq.resources <= table_.need[i]) || !(rq.resources <= avail))
+			continue;
+		grant_(i, rq);
+		if ((ss = is_safety_(avail)).size() == (size_t)gid_num) {
+			granted[cand[j]] = true;
+			best_ss = ss;
+			++lo;
+		}
+		else
+			revoke_(i, rq);
+	}
+	for (int k = 0; k < (int)batch_.size(); ++k) {
+		auto const& rq = batch_[k];
+		cout << "gid " << rq.gid << ' ' << OP_NAME_[rq.op]
+			<< ' ' << print_all_(rq.resources) << ":\n";
+		if (!~idx[k]) {
+			log_.decide(rq, unknown_);
+			cout << "unknown gid, not granted\n";
+		}
+		else if (!(rq.resources <= table_.need[idx[k]] + (granted[k] ? rq.resources : R_t{}))) {
+			log_.decide(rq, invalid_);
+			cout << "invalid request, not granted\n";
+		}
+		else if (granted[k]) {
+			stats_.grant(idx[k]);
+			log_.decide(rq, granted_);
+			cout << "granted in batch\n";
+		}
+		else {
+			// AVAILABLE only shrank during the batch, so one that fits now fit when it was checked
+			log_.decide(rq, rq.resources <= avail ? unsafe_ : short_);
+			cout << "must wait\n";
+			// the resources the stuck check lacked change with every later grant, retry it on any release
+			vector<int> keys(R_NUM);
+			iota(begin(keys), end(keys), 0);
+			waiting_.push(rq, rq.resources <= avail ? keys : short_keys_(rq));
+		}
+	}
+	cout << "batch of " << batch_.size() << ": " << lo << " granted";
+	if (lo)
+		cout << ", safe sequence = " << print_all_(best_ss);
+	cout << '\n';
+	cout << "\nAVAILABLE = " << print_all_(avail) << "\n\n";
+	batch_.clear();
+}
+
+void batch_request_(req_t const& rq) {
+	if (batch_size_ > 1 && rq.op == op_alloc) {
+		batch_.push_back(rq);
+		if ((int)batch_.size() == batch_size_)
+			flush_batch_();
+		return;
+	}
+	flush_batch_();
+	handle_(rq);
+}
+
+// thousands of queued requests, releases retried by rescanning the whole queue vs the index
+// every process competes for its home resource gid % R_NUM only and asks for one unit of it.
+// one request per resource is granted, the rest are unsafe and queue up. then each release
+// returns one unit of a home resource from a process that holds it.
+void bench_wait_(int w, int rels) {
+	vector<pair<gid_t_, R_t> > max_rows, alloc_rows;
+	vector<req_t> trace;
+	for (int gid = 0; gid < w; ++gid) {
+		R_t m{}, one{};
+		m[gid % R_NUM] = 3;
+		one[gid % R_NUM] = 1;
+		max_rows.push_back({ gid, m });
+		alloc_rows.push_back({ gid, R_t{} });
+		trace.push_back({ gid, one, op_alloc });
+	}
+
+	auto* buf = cout.rdbuf(nullptr); // no output, only the decisions
+	for (bool rescan_all : { true, false }) {
+		build_state_(max_rows, alloc_rows);
+		checker_.check_num = 0;
+		for (auto& r : avail)
+			r = 3;
+		waiting_ = wait_index_{};
+		waiting_.rescan_all = rescan_all;
+		for (auto const& rq : trace)
+			handle_(rq);
+		int queued = waiting_.size();
+
+		auto t0 = chrono::steady_clock::now();
+		for (int k = 0; k < rels; ++k) {
+			req_t rq{ -1, {}, op_rels };
+			int h = k % R_NUM;
+			for (int gid = h; gid < w && !~rq.gid; gid += R_NUM)
+				if (table_.alloc[gid][h])
+					rq.gid = gid;
+			rq.resources[h] = 1;
+			handle_(rq);
+		}
+		auto t1 = chrono::steady_clock::now();
+		clog << (rescan_all ? "rescan" : "index ") << " queued = " << setw(6) << queued
+			<< ", " << rels << " releases: " << setw(9) << chrono::duration<double, milli>(t1 - t0).count() << " ms, "
+			<< setw(8) << checker_.check_num - w << " safety checks, "
+			<< setw(6) << waiting_.size() << " still waiting\n";
+	}
+	cout.rdbuf(buf);
+}
+
+// a generated state (gen_data.cpp): the safety check alone on the initial state,
+// then every request of the file end to end with the output muted
+void bench_file_(string const& file, int check_num) {
+	vector<req_t> trace;
+	auto* buf = cout.rdbuf(nullptr);
+	init_(file, determine_init, [&trace](req_t const& rq) { trace.push_back(rq); });
+
+	size_t safe = 0;
+	auto t0 = chrono::steady_clock::now();
+	for (int k = 0; k < check_num; ++k)
+		safe += is_safety_(avail).size();
+	auto t1 = chrono::steady_clock::now();
+	long long checks = checker_.check_num;
+	for (auto const& rq : trace)
+		handle_(rq);
+	auto t2 = chrono::steady_clock::now();
+	cout.rdbuf(buf);
+
+	double check_us = chrono::duration<double, micro>(t1 - t0).count() / check_num;
+	double sec = chrono::duration<double>(t2 - t1).count();
+	cout << "processes " << setw(7) << gid_num << (safe == (size_t)gid_num * check_num ? " (safe)  " : " (unsafe)")
+		<< ": is_safety_ " << fixed << setprecision(2) << setw(10) << check_us << " us, "
+		<< setw(7) << trace.size() << " requests " << setprecision(0) << setw(9) << trace.size() / sec << " req/s, "
+		<< setprecision(2) << (double)(checker_.check_num - checks) / max<size_t>(trace.size(), 1) << " checks/req, "
+		<< waiting_.size() << " still waiting\n" << defaultfloat;
+}
+
+// avoidance vs detection on the same trace, output muted
+// latency is the time handle_ takes for one request, retries of waiting requests included
+const int DETECT_PERIOD_ = 100; // requests between two detection runs by default
+
+void bench_detect_(string const& file, int period) {
+	vector<req_t> trace;
+	auto* buf = cout.rdbuf(nullptr);
+	init_(file, [] {}, [&trace](req_t const& rq) { trace.push_back(rq); });
+	R_t avail0 = avail;
+	for (int p : { 0, period }) {
+		avail = avail0;
+		determine_init();
+		checker_.check_num = 0;
+		waiting_ = wait_index_{};
+		log_.count = {};
+		detector_ = deadlock_detector_{};
+		detector_.period = p;
+		detector_.build(table_);
+		auto* handle = p ? detect_handle_ : handle_;
+
+		vector<double> lat(trace.size());
+		auto t0 = chrono::steady_clock::now();
+		for (size_t k = 0; k < trace.size(); ++k) {
+			auto s = chrono::steady_clock::now();
+			handle(trace[k]);
+			lat[k] = chrono::duration<double, micro>(chrono::steady_clock::now() - s).count();
+		}
+		if (p)
+			detect_();
+		double sec = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+		sort(begin(lat), end(lat));
+		auto pct = [&lat](double q) { return lat.empty() ? 0 : lat[min(lat.size() - 1, (size_t)(q * lat.size()))]; };
+		clog << (p ? "detect " : "avoid  ") << setw(7) << trace.size() << " requests " << fixed << setprecision(0)
+			<< setw(9) << trace.size() / sec << " req/s, latency p50 " << setprecision(2) << pct(0.5)
+			<< " p99 " << pct(0.99) << " max " << pct(1) << " us, " << stats_.granted << " of "
+			<< stats_.submitted << " granted, " << waiting_.size() << " still waiting, ";
+		if (p)
+			clog << detector_.run_num << " detection runs, " << detector_.victims.size() << " victims, "
+				<< log_.count[aborted_] << " requests aborted\n";
+		else
+			clog << checker_.check_num << " safety checks\n";
+		clog << defaultfloat;
+	}
+	cout.rdbuf(buf);
+}
+
+// banker's allocator shared by many threads
+// a request runs its safety check without any lock on an immutable snapshot of the state.
+// the snapshot is shared by every thread: the first request after a grant or a release
+// rebuilds it once under the read lock, the others only take a reference. the check leaves
+// the snapshot untouched, the requesting process is tested on its own instead of through
+// the sorted orders. the commit takes the write lock only to recheck that no other grant
+// happened since the snapshot: releases keep a safe state safe, so they don't invalidate it.
+// a request that lost that race is checked again under the write lock instead of retrying.
+// the lock prefers writers, so commits and releases don't starve behind the readers.
+struct banker_alloc_ {
+	enum result_t { GRANTED_, MUST_WAIT_, INVALID_, };
+
+	// everything a safety check reads, as of state version ver
+	struct snapshot_ {
+		long long ver, grant_ver;
+		vector<R_t> alloc, need;
+		array<vector<int>, R_NUM> order;
+		R_t avail;
+
+		snapshot_(banker_alloc_ const& a) : ver(a.state_ver), grant_ver(a.grant_ver),
+			alloc(a.tab.alloc), need(a.tab.need), order(a.checker.order), avail(a.avail) {}
+
+		// safe with res granted to i: i is left out of the orders and tested on its own
+		bool safe_with(int i, R_t const& res) const {
+			thread_local vector<int> cnt, ready;
+			int n = need.size(), finished = 0;
+			cnt.assign(n, 0);
+			ready.clear();
+			R_t av = avail - res, need_i = need[i] - res;
+			array<int, R_NUM> ptr{};
+			bool i_ready = false;
+			auto advance = [&] {
+				for (int r = 0; r < R_NUM; ++r)
+					for (auto& k = ptr[r]; k < n && need[order[r][k]][r] <= av[r]; ++k) {
+						int j = order[r][k];
+						if (j != i && ++cnt[j] == R_NUM)
+							ready.push_back(j);
+					}
+				if (!i_ready && need_i <= av) {
+					i_ready = true;
+					ready.push_back(i);
+				}
+			};
+			for (advance(); !ready.empty(); advance()) {
+				int j = ready.back();
+				ready.pop_back();
+				av += j == i ? alloc[i] + res : alloc[j];
+				++finished;
+			}
+			return finished == n;
+		}
+	};
+
+	state_table_ tab;  // gids and index_ never change after construction
+	safety_checker_ checker;
+	R_t avail;
+	pthread_rwlock_t lock;
+	pthread_mutex_t wait_mutex, snap_mutex;
+	pthread_cond_t released;
+	shared_ptr<const snapshot_> snap_;
+	long long state_ver = 0; // every grant and release, under the write lock
+	atomic<long long> grant_ver{ 0 }, release_ver{ 0 }, retry_num{ 0 };
+	bool optimistic = true; // false: the whole check runs under the write lock
+
+	banker_alloc_(state_table_ const& t, R_t const& av) : tab(t), avail(av) {
+		checker.build(tab);
+		pthread_rwlockattr_t attr;
+		pthread_rwlockattr_init(&attr);
+		pthread_rwlockattr_setkind_np(&attr, PTHREAD_RWLOCK_PREFER_WRITER_NONRECURSIVE_NP);
+		pthread_rwlock_init(&lock, &attr);
+		pthread_rwlockattr_destroy(&attr);
+		pthread_mutex_init(&wait_mutex, NULL);
+		pthread_mutex_init(&snap_mutex, NULL);
+		pthread_cond_init(&released, NULL);
+	}
+	banker_alloc_(banker_alloc_ const&) = delete;
+	~banker_alloc_() {
+		pthread_rwlock_destroy(&lock);
+		pthread_mutex_destroy(&wait_mutex);
+		pthread_mutex_destroy(&snap_mutex);
+		pthread_cond_destroy(&released);
+	}
+
+	// caller holds the read lock, so the state can't change while a stale snapshot is rebuilt
+	shared_ptr<const snapshot_> snapshot() {
+		pthread_mutex_lock(&snap_mutex);
+		if (!snap_ || snap_->ver != state_ver)
+			snap_ = make_shared<const snapshot_>(*this);
+		auto snap = snap_;
+		pthread_mutex_unlock(&snap_mutex);
+		return snap;
+	}
+
+	// one decision without blocking, seen gets the release version the decision was based on
+	result_t try_allocate(gid_t_ gid, R_t const& res, long long* seen = nullptr) {
+		int i = tab.find(gid);
+		if (!~i)
+			return INVALID_;
+		if (optimistic)
+			pthread_rwlock_rdlock(&lock);
+		else
+			pthread_rwlock_wrlock(&lock);
+		if (seen)
+			*seen = release_ver;
+		if (!(res <= tab.need[i])) {
+			pthread_rwlock_unlock(&lock);
+			return INVALID_;
+		}
+		if (!(res <= avail)) {
+			pthread_rwlock_unlock(&lock);
+			return MUST_WAIT_;
+		}
+		if (!optimistic) {
+			bool safe = commit_if_safe_(i, res);
+			pthread_rwlock_unlock(&lock);
+			return safe ? GRANTED_ : MUST_WAIT_;
+		}
+		auto snap = snapshot();
+		pthread_rwlock_unlock(&lock);
+
+		// grants never make an unsafe state safe, a newer snapshot would be unsafe too
+		if (!snap->safe_with(i, res))
+			return MUST_WAIT_;
+
+		pthread_rwlock_wrlock(&lock);
+		bool safe = true;
+		if (grant_ver == snap->grant_ver)
+			apply_(i, res);
+		else {
+			++retry_num;
+			safe = res <= tab.need[i] && res <= avail && commit_if_safe_(i, res);
+		}
+		if (safe)
+			++grant_ver;
+		pthread_rwlock_unlock(&lock);
+		return safe ? GRANTED_ : MUST_WAIT_;
+	}
+
+	// blocks until granted, false for an invalid request
+	bool allocate(gid_t_ gid, R_t const& res) {
+		return allocate_until_(gid, res, nullptr) == GRANTED_;
+	}
+
+	// false for an invalid request or when timeout_ms passes first
+	bool allocate_for(gid_t_ gid, R_t const& res, long long timeout_ms) {
+		timespec deadline;
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		deadline.tv_sec += timeout_ms / 1000;
+		deadline.tv_nsec += timeout_ms % 1000 * 1'000'000;
+		if (deadline.tv_nsec >= 1'000'000'000) {
+			++deadline.tv_sec;
+			deadline.tv_nsec -= 1'000'000'000;
+		}
+		return allocate_until_(gid, res, &deadline) == GRANTED_;
+	}
+
+	bool release(gid_t_ gid, R_t const& res) {
+		int i = tab.find(gid);
+		if (!~i)
+			return false;
+		pthread_rwlock_wrlock(&lock);
+		if (!(res <= tab.alloc[i])) {
+			pthread_rwlock_unlock(&lock);
+			return false;
+		}
+		apply_(i, R_t{} - res);
+		++release_ver;
+		pthread_rwlock_unlock(&lock);
+
+		pthread_mutex_lock(&wait_mutex);
+		pthread_cond_broadcast(&released);
+		pthread_mutex_unlock(&wait_mutex);
+		return true;
+	}
+
+	result_t allocate_until_(gid_t_ gid, R_t const& res, timespec const* deadline) {
+		while (true) {
+			long long seen;
+			auto result = try_allocate(gid, res, &seen);
+			if (result != MUST_WAIT_)
+				return result;
+			// only a release can change the decision
+			pthread_mutex_lock(&wait_mutex);
+			while (release_ver == seen)
+				if (!deadline)
+					pthread_cond_wait(&released, &wait_mutex);
+				else if (pthread_cond_timedwait(&released, &wait_mutex, deadline) == ETIMEDOUT) {
+					pthread_mutex_unlock(&wait_mutex);
+					return MUST_WAIT_;
+				}
+			pthread_mutex_unlock(&wait_mutex);
+		}
+	}
+
+	// caller holds the write lock
+	bool commit_if_safe_(int i, R_t const& res) {
+		apply_(i, res);
+		if (checker.check(avail).size() == (size_t)tab.size())
+			return true;
+		apply_(i, R_t{} - res);
+		return false;
+	}
+
+	// caller holds the write lock
+	void apply_(int i, R_t const& res) {
+		avail -= res;
+		tab.alloc[i] += res;
+		tab.need[i] -= res;
+		checker.update(i);
+		++state_ver;
+	}
+};
+
+struct bench_worker_t {
+	banker_alloc_* a;
+	int t, thread_num, ops;
+	long long granted = 0, timeouts = 0;
+};
+
+void* bench_worker_(void* ptr) {
+	auto& w = *reinterpret_cast<bench_worker_t*>(ptr);
+	mt19937 rng(w.t);
+	int n = w.a->tab.size();
+	for (int k = 0; k < w.ops; ++k) {
+		// every thread works on its own processes
+		gid_t_ gid = w.t + rng() % (n / w.thread_num) * w.thread_num;
+		R_t res{};
+		res[rng() % R_NUM] = 1;
+		if (w.a->allocate_for(gid, res, 10)) {
+			++w.granted;
+			w.a->release(gid, res);
+		}
+		else
+			++w.timeouts;
+	}
+	return NULL;
+}
+
+// grants per second of allocate_for() / release() pairs, checks under the write lock vs optimistic
+void bench_threads_(int max_thread_num) {
+	const int n = 1000, OPS = 10'000; // OPS requests shared by all threads
+	vector<pair<gid_t_, R_t> > max_rows, alloc_rows;
+	for (int gid = 0; gid < n; ++gid) {
+		R_t m;
+		for (auto& r : m)
+			r = 2;
+		max_rows.push_back({ gid, m });
+		alloc_rows.push_back({ gid, R_t{} });
+	}
+	state_table_ t;
+	t.build(max_rows, alloc_rows);
+	R_t av;
+	for (auto& r : av)
+		r = 2 + max_thread_num;
+
+	for (int thread_num = 1; thread_num <= max_thread_num; thread_num *= 2)
+		for (bool optimistic : { false, true }) {
+			banker_alloc_ a(t, av);
+			a.optimistic = optimistic;
+			vector<bench_worker_t> ws(thread_num);
+			vector<pthread_t> threads(thread_num);
+			auto t0 = chrono::steady_clock::now();
+			for (int k = 0; k < thread_num; ++k) {
+				ws[k] = { &a, k, thread_num, OPS / thread_num };
+				pthread_create(&threads[k], NULL, bench_worker_, (void*)&ws[k]);
 			}
+			long long granted = 0, timeouts = 0;
+			for (int k = 0; k < thread_num; ++k) {
+				pthread_join(threads[k], NULL);
+				granted += ws[k].granted;
+				timeouts += ws[k].timeouts;
+			}
+			auto t1 = chrono::steady_clock::now();
+			double sec = chrono::duration<double>(t1 - t0).count();
+			cout << "threads = " << setw(3) << thread_num << (optimistic ? " optimistic: " : " locked:     ")
+				<< setw(10) << (long long)(granted / sec) << " grants/s, "
+				<< setw(7) << a.retry_num << " retries, " << setw(5) << timeouts << " timeouts\n";
 		}
-		cout << "\nAVAILABLE = " << print_all_(avail) << "\n\n";
+}
+
+// the whole of s as a non-negative int, -1 if it is anything else
+int parse_count_(const char* s) {
+	int v;
+	auto e = s + strlen(s);
+	auto [p, ec] = from_chars(s, e, v);
+	return ec == errc() && p == e && v >= 0 ? v : -1;
+}
+
+int main(int argc, char* argv[]) {
+	if (argc == 3 && string(argv[1]) == "--bench-lookup") {
+		for (int n = 100; n <= stoi(argv[2]); n *= 10)
+			bench_lookup_(n);
+		return 0;
+	}
+	if (argc == 3 && string(argv[1]) == "--bench-threads") {
+		bench_threads_(stoi(argv[2]));
+		return 0;
+	}
+	if ((argc == 3 || argc == 4) && string(argv[1]) == "--bench-wait") {
+		bench_wait_(stoi(argv[2]), argc == 4 ? stoi(argv[3]) : 20);
+		return 0;
+	}
+	if ((argc == 3 || (argc == 4 && parse_count_(argv[3]) > 0)) && string(argv[1]) == "--bench-detect") {
+		bench_detect_(argv[2], argc == 4 ? parse_count_(argv[3]) : DETECT_PERIOD_);
+		return 0;
+	}
+	if ((argc == 3 || argc == 4) && string(argv[1]) == "--bench-file") {
+		bench_file_(argv[2], argc == 4 ? stoi(argv[3]) : 100);
+		return 0;
+	}
+	string file;
+	bool detect = false;
+	for (int k = 1; k < argc; ++k) {
+		if (string(argv[k]) == "--batch" && k + 1 < argc && parse_count_(argv[k + 1]) > 0)
+			batch_size_ = parse_count_(argv[++k]);
+		else if (string(argv[k]) == "--detect") {
+			// the next argument is the period only if it is a number, a file name may start with a digit
+			detect = true;
+			detector_.period = k + 1 < argc && ~parse_count_(argv[k + 1]) ? parse_count_(argv[++k]) : DETECT_PERIOD_;
+		}
+		else if (string(argv[k]) == "--quiet")
+			out_mode_ = quiet_;
+		else if (string(argv[k]) == "--lines")
+			out_mode_ = lines_;
+		else if (string(argv[k]) == "--binlog" && k + 1 < argc)
+			log_.open_bin(argv[++k]);
+		else if (file.empty() && argv[k][0] != '-')
+			file = argv[k];
+		else
+			file = "", k = argc;
+	}
+	if (file.empty() || (batch_size_ && detect) || (detect && !detector_.period)) {
+		cerr << "No input files or too many input files!\n"
+			"usage: " << argv[0] << " file [--batch #batch_size | --detect [#period]] [--quiet | --lines] [--binlog #log_file]\n"
+			"       " << argv[0] << " --bench-lookup #max_process_num\n"
+			"       " << argv[0] << " --bench-wait #queued_request_num [#release_num]\n"
+			"       " << argv[0] << " --bench-threads #max_thread_num\n"
+			"       " << argv[0] << " --bench-file file [#check_num]\n"
+			"       " << argv[0] << " --bench-detect file [#period]\n";
+		exit(EXIT_FAILURE);
+	}
+	// everything but the human trace bypasses cout
+	auto* buf = cout.rdbuf();
+	if (out_mode_ != human_)
+		cout.rdbuf(nullptr);
+	if (out_mode_ == lines_)
+		log_.txt = stdout;
+
+	auto t0 = chrono::steady_clock::now();
+	if (detector_.period) {
+		init_(file, [] { determine_init(); detector_.build(table_); }, detect_handle_);
+		auto victim_num = detector_.victims.size();
+		detect_();
+		if (detector_.victims.size() > victim_num)
+			cout << "\nAVAILABLE = " << print_all_(avail) << "\n\n";
+	}
+	else if (!batch_size_)
+		init_(file, determine_init, handle_);
+	else {
+		init_(file, determine_init, batch_request_);
+		flush_batch_();
+	}
+	auto t1 = chrono::steady_clock::now();
+	log_.close();
+	cout.rdbuf(buf);
+
+	if (out_mode_ == quiet_) {
+		cout << "decisions: " << accumulate(begin(log_.count), end(log_.count), 0LL);
+		for (int d = 0; d < (int)log_.count.size(); ++d)
+			cout << ", " << DEC_NAME_[d] << ' ' << log_.count[d];
+		if (detector_.period)
+			cout << "\ndetection runs: " << detector_.run_num << ", victims: " << detector_.victims.size();
+		cout << "\nstill waiting: " << waiting_.size()
+			<< "\nAVAILABLE = " << print_all_(avail) << '\n';
 	}
+	if (!batch_size_)
+		return 0;
+	double sec = chrono::duration<double>(t1 - t0).count();
+	clog << "batch size " << batch_size_ << ": " << stats_.granted << " of " << stats_.submitted
+		<< " allocations granted, " << fixed << setprecision(0) << stats_.granted / sec << " grants/s, "
+		<< checker_.check_num << " safety checks, fairness " << setprecision(4) << stats_.fairness() << '\n';
 }
\ No newline at end of file
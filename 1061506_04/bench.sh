@@ -0,0 +1,20 @@
+#!/bin/sh
+# is_safety_ and request throughput of prog4 over generated inputs
+# exec: ./bench.sh [#max_process_num] [#request_num]
+set -e
+SRC=$(cd "$(dirname "$0")" && pwd)
+MAX=${1:-10000}
+REQ=${2:-10000}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+g++ -o "$TMP/gen_data" "$SRC/gen_data.cpp" -std=c++17 -O2
+g++ -o "$TMP/prog4" "$SRC/1061506_04_3.cpp" -std=c++17 -O2 -lpthread
+for contention in 0 0.5 0.9; do
+	echo "contention $contention"
+	n=100
+	while [ "$n" -le "$MAX" ]; do
+		"$TMP/gen_data" "$n" "$REQ" --contention "$contention" --seed "$n" > "$TMP/data.txt"
+		"$TMP/prog4" --bench-file "$TMP/data.txt" 20
+		n=$((n * 10))
+	done
+done
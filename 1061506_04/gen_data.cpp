@@ -0,0 +1,105 @@
+/*
+    synthetic input for prog4
+    compile: g++ -o gen_data gen_data.cpp -std=c++17 -O2
+    exec: ./gen_data #process_num #request_num [--res #n] [--contention #0~1] [--alloc #0~1] [--seed #n] > file
+      --res         resource number, must match RES_NUM of prog4 (default 5)
+      --contention  0: AVAILABLE covers every MAX, 1: AVAILABLE just keeps the initial state safe (default 0.5)
+      --alloc       share of allocate requests, the rest are releases (default 0.7)
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+using namespace std;
+
+int main(int argc, char* argv[]) {
+	if (argc < 3 || argc % 2 == 0) {
+		fprintf(stderr, "usage: %s #process_num #request_num [--res #n] [--contention #0~1] [--alloc #0~1] [--seed #n]\n", argv[0]);
+		exit(EXIT_FAILURE);
+	}
+	int n = stoi(argv[1]), q = stoi(argv[2]), R = 5;
+	double contention = 0.5, alloc_ratio = 0.7;
+	unsigned seed = 0;
+	for (int k = 3; k < argc; k += 2) {
+		if (!strcmp(argv[k], "--res"))
+			R = stoi(argv[k + 1]);
+		else if (!strcmp(argv[k], "--contention"))
+			contention = stod(argv[k + 1]);
+		else if (!strcmp(argv[k], "--alloc"))
+			alloc_ratio = stod(argv[k + 1]);
+		else if (!strcmp(argv[k], "--seed"))
+			seed = stoul(argv[k + 1]);
+		else {
+			fprintf(stderr, "unknown option \"%s\"\n", argv[k]);
+			exit(EXIT_FAILURE);
+		}
+	}
+	if (n < 1 || q < 0 || R < 1 || contention < 0 || contention > 1 || alloc_ratio < 0 || alloc_ratio > 1) {
+		fprintf(stderr, "invalid arguments\n");
+		exit(EXIT_FAILURE);
+	}
+
+	mt19937 rng(seed);
+	auto rnd = [&rng](int begin, int end) {
+		return uniform_int_distribution<int>(begin, end)(rng);
+	};
+	vector<vector<int> > max(n, vector<int>(R)), alloc(n, vector<int>(R));
+	for (int i = 0; i < n; ++i)
+		for (int r = 0; r < R; ++r) {
+			max[i][r] = rnd(0, 9);
+			alloc[i][r] = rnd(0, max[i][r]);
+		}
+
+	// the least AVAILABLE that lets the processes finish in a random order,
+	// then a share of the rest of the total MAX on top
+	vector<int> order(n), avail(R), held(R), total(R);
+	iota(order.begin(), order.end(), 0);
+	shuffle(order.begin(), order.end(), rng);
+	for (int i : order)
+		for (int r = 0; r < R; ++r) {
+			avail[r] = std::max(avail[r], max[i][r] - alloc[i][r] - held[r]);
+			held[r] += alloc[i][r];
+			total[r] += max[i][r];
+		}
+	for (int r = 0; r < R; ++r)
+		avail[r] += (1 - contention) * std::max(0, total[r] - held[r] - avail[r]);
+
+	auto put_row = [R](int gid, vector<int> const& v) {
+		if (~gid)
+			printf("%d ", gid);
+		for (int r = 0; r < R; ++r)
+			printf(r ? " %d" : "%d", v[r]);
+	};
+	puts("#AVAILABLE");
+	put_row(-1, avail);
+	puts("");
+	puts("#MAX");
+	for (int i = 0; i < n; ++i) {
+		put_row(i, max[i]);
+		puts("");
+	}
+	puts("#ALLOCATION");
+	for (int i = 0; i < n; ++i) {
+		put_row(i, alloc[i]);
+		puts("");
+	}
+
+	// requests stay within MAX and the allocation they would have if every one was granted
+	puts("#REQUEST");
+	vector<int> rs(R);
+	for (int k = 0; k < q; ++k) {
+		int i = rnd(0, n - 1);
+		bool a = uniform_real_distribution<double>(0, 1)(rng) < alloc_ratio;
+		for (int r = 0; r < R; ++r) {
+			int room = a ? max[i][r] - alloc[i][r] : alloc[i][r];
+			rs[r] = room && rnd(0, 1) ? rnd(1, std::min(room, 3)) : 0;
+			alloc[i][r] += a ? rs[r] : -rs[r];
+		}
+		put_row(i, rs);
+		puts(a ? " a" : " r");
+	}
+}